@@ -0,0 +1,179 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * xsetup-center - center the TDM greeter the moment it maps
+ *
+ * Replacement for the wmctrl/xwininfo polling loop in Xsetup: connect
+ * to the display once, subscribe to SubstructureNotify on the root
+ * window, and the instant a window whose WM_CLASS matches appears, move
+ * it to the center of the scaled workspace.  No per-attempt forks, no
+ * 100 ms sleeps - the dialog is positioned within milliseconds of
+ * mapping.
+ *
+ * usage: xsetup-center <class-substring> <workspace-width> <workspace-height>
+ * e.g.:  xsetup-center tdmgreet 960 540
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <time.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#define TIMEOUT_S 10
+
+static const char *class_substring;
+static int workspace_w, workspace_h;
+
+static int
+window_class_matches(Display *dpy, Window win)
+{
+    XClassHint hint;
+    int match = 0;
+
+    if (!XGetClassHint(dpy, win, &hint))
+        return 0;
+
+    if ((hint.res_name && strstr(hint.res_name, class_substring)) ||
+            (hint.res_class && strstr(hint.res_class, class_substring)))
+        match = 1;
+
+    if (hint.res_name)
+        XFree(hint.res_name);
+    if (hint.res_class)
+        XFree(hint.res_class);
+    return match;
+}
+
+static int
+center_window(Display *dpy, Window win)
+{
+    XWindowAttributes attr;
+
+    if (!XGetWindowAttributes(dpy, win, &attr))
+        return 0;
+
+    XMoveWindow(dpy, win,
+            (workspace_w - attr.width) / 2,
+            (workspace_h - attr.height) / 2);
+    XFlush(dpy);
+    return 1;
+}
+
+/* The greeter may have mapped before we subscribed; check existing windows. */
+static int
+scan_existing(Display *dpy, Window root)
+{
+    Window unused_root, unused_parent, *children;
+    unsigned int nchildren, i;
+    int done = 0;
+
+    if (!XQueryTree(dpy, root, &unused_root, &unused_parent, &children, &nchildren))
+        return 0;
+
+    for (i = 0; i < nchildren && !done; i++) {
+        if (window_class_matches(dpy, children[i]))
+            done = center_window(dpy, children[i]);
+    }
+
+    if (children)
+        XFree(children);
+    return done;
+}
+
+static int
+ignore_x_error(Display *dpy, XErrorEvent *err)
+{
+    /* windows may vanish between notify and inspection; not fatal */
+    (void)dpy;
+    (void)err;
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    Display *dpy;
+    Window root;
+    time_t deadline;
+    int xfd;
+
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s <class-substring> <workspace-width> <workspace-height>\n",
+                argv[0]);
+        return 1;
+    }
+
+    class_substring = argv[1];
+    workspace_w = atoi(argv[2]);
+    workspace_h = atoi(argv[3]);
+    if (workspace_w <= 0 || workspace_h <= 0) {
+        fprintf(stderr, "invalid workspace size\n");
+        return 1;
+    }
+
+    dpy = XOpenDisplay(NULL);
+    if (!dpy) {
+        fprintf(stderr, "cannot open display\n");
+        return 1;
+    }
+
+    XSetErrorHandler(ignore_x_error);
+    root = DefaultRootWindow(dpy);
+    XSelectInput(dpy, root, SubstructureNotifyMask);
+
+    if (scan_existing(dpy, root)) {
+        XCloseDisplay(dpy);
+        return 0;
+    }
+
+    xfd = ConnectionNumber(dpy);
+    deadline = time(NULL) + TIMEOUT_S;
+
+    for (;;) {
+        while (XPending(dpy)) {
+            XEvent ev;
+
+            XNextEvent(dpy, &ev);
+            if (ev.type == MapNotify &&
+                    window_class_matches(dpy, ev.xmap.window) &&
+                    center_window(dpy, ev.xmap.window)) {
+                XCloseDisplay(dpy);
+                return 0;
+            }
+        }
+
+        time_t now = time(NULL);
+        if (now >= deadline)
+            break;
+
+        struct timeval tv = { .tv_sec = deadline - now, .tv_usec = 0 };
+        fd_set fds;
+
+        FD_ZERO(&fds);
+        FD_SET(xfd, &fds);
+        if (select(xfd + 1, &fds, NULL, NULL, &tv) < 0)
+            break;
+    }
+
+    fprintf(stderr, "no window matching '%s' appeared within %d s\n",
+            class_substring, TIMEOUT_S);
+    XCloseDisplay(dpy);
+    return 1;
+}
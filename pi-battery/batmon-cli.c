@@ -0,0 +1,210 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * batmon-cli - thin native front-end over libbatmon, replacing the
+ * pi-battery.sh awk/bc/i2cget fork storm with one process.  Prints the
+ * same human-readable status block the shell script logged and pushes
+ * every cycle into /dev/pi_battery.
+ *
+ * Usage:
+ *   batmon-cli           one cycle, print the block, exit
+ *   batmon-cli -l [sec]  loop forever with the given period (default 2)
+ *   batmon-cli -q        suppress the status block (with -l: quiet daemon)
+ *   batmon-cli -o FILE   rewrite FILE with the latest block every cycle
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libbatmon.h"
+
+#define I2C_BUS         2
+#define BATFILE         "/dev/pi_battery"
+
+static volatile sig_atomic_t running = 1;
+
+static void
+handle_signal(int sig)
+{
+    (void)sig;
+    running = 0;
+}
+
+static const char *
+status_name(int status_int)
+{
+    switch (status_int) {
+        case BATMON_STATUS_FULL:        return "Full";
+        case BATMON_STATUS_CHARGING:    return "Charging";
+        case BATMON_STATUS_DISCHARGING: return "Discharging";
+        default:                        return "n/a";
+    }
+}
+
+static void
+print_block(FILE *out, int bus_voltage_mV, double power_W,
+        const struct batmon_result *res)
+{
+    char stamp[32];
+    time_t now = time(NULL);
+
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+
+    fprintf(out, "--- [%s] -------------------------\n\n", stamp);
+    fprintf(out, "Battery info\n");
+    fprintf(out, "---------------------------------------------------\n");
+    fprintf(out, "Last max. capacity:  %lld mAh\n", res->charge_full_uAh / 1000);
+    fprintf(out, "Remaining capacity:  %lld mAh\n", res->charge_now_uAh / 1000);
+    fprintf(out, "\n");
+    fprintf(out, "Voltage:             %d mV (avg %d mV)\n",
+            bus_voltage_mV, res->bus_voltage_avg_mV);
+    fprintf(out, "Current:             %.3f A (avg %.3f A)\n",
+            (double)res->current_now_uA / 1000000.0, res->current_avg_A);
+    fprintf(out, "Power:               %.3f W (avg %.3f W)\n",
+            power_W, res->power_avg_W);
+    fprintf(out, "\n");
+    fprintf(out, "Status:              %s\n", status_name(res->status_int));
+    fprintf(out, "Charge:              %d %%\n", res->soc_pct);
+    fprintf(out, "Remaining time:      %d h %02d min\n\n",
+            res->battery_remain_sec / 3600, (res->battery_remain_sec % 3600) / 60);
+    fflush(out);
+}
+
+/* Truncate-and-rewrite keeps the log one block deep, like the shell
+ * script's per-cycle tee - important on tmpfs, where an append-only log
+ * would eat memory until the next reboot. */
+static void
+write_log_block(const char *path, int bus_voltage_mV, double power_W,
+        const struct batmon_result *res)
+{
+    FILE *out = fopen(path, "w");
+
+    if (!out) {
+        fprintf(stderr, "WARN: cannot write %s: %s\n", path, strerror(errno));
+        return;
+    }
+    print_block(out, bus_voltage_mV, power_W, res);
+    fclose(out);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct batmon *bm;
+    const char *logfile = NULL;
+    int loop = 0, quiet = 0, period_s = 2;
+    int i2c_fd, bat_fd;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l::qo:h")) != -1) {
+        switch (opt) {
+            case 'l':
+                loop = 1;
+                if (optarg)
+                    period_s = atoi(optarg);
+                else if (optind < argc && argv[optind][0] != '-')
+                    period_s = atoi(argv[optind++]);
+                if (period_s < 1)
+                    period_s = 2;
+                break;
+            case 'q':
+                quiet = 1;
+                break;
+            case 'o':
+                logfile = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-l [seconds]] [-q] [-o logfile]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    i2c_fd = batmon_i2c_open(I2C_BUS);
+    if (i2c_fd < 0) {
+        fprintf(stderr, "ERROR: cannot open /dev/i2c-%d: %s\n",
+                I2C_BUS, strerror(errno));
+        return 1;
+    }
+
+    if (batmon_ina219_configure(i2c_fd)) {
+        fprintf(stderr, "ERROR: INA219 configuration failed: %s\n", strerror(errno));
+        return 1;
+    }
+
+    bat_fd = open(BATFILE, O_WRONLY);
+    if (bat_fd < 0)
+        fprintf(stderr, "WARN: BATFILE %s not found\n", BATFILE);
+
+    bm = batmon_new();
+    if (!bm)
+        return 1;
+
+    if (loop)
+        sleep(1);  /* let the first conversion land */
+
+    do {
+        struct batmon_result res;
+        struct pi_battery_report report;
+        int bus_raw, shunt_raw, current_raw, power_raw;
+        int bus_voltage_mV;
+        double power_W;
+
+        if (batmon_ina219_read_all(i2c_fd, &bus_raw, &shunt_raw,
+                &current_raw, &power_raw)) {
+            fprintf(stderr, "WARN: I2C read failed: %s\n", strerror(errno));
+            if (!loop)
+                return 1;
+            sleep(period_s);
+            continue;
+        }
+
+        bus_voltage_mV = batmon_decode_bus_mV(bus_raw);
+        power_W = batmon_decode_power_W(power_raw);
+
+        batmon_step(bm, bus_voltage_mV,
+                batmon_decode_shunt_mV(shunt_raw),
+                batmon_decode_current_A(current_raw),
+                power_W, (long long)time(NULL), &res);
+
+        batmon_fill_report(&res, bus_voltage_mV, &report);
+
+        if (bat_fd >= 0 && batmon_write_batfile(bat_fd, &report))
+            fprintf(stderr, "WARN: Failed to write BATFILE: %s\n", strerror(errno));
+
+        if (!quiet)
+            print_block(stdout, bus_voltage_mV, power_W, &res);
+        if (logfile)
+            write_log_block(logfile, bus_voltage_mV, power_W, &res);
+
+        if (loop)
+            sleep(period_s);
+    } while (loop && running);
+
+    batmon_free(bm);
+    if (bat_fd >= 0)
+        close(bat_fd);
+    close(i2c_fd);
+    return 0;
+}
@@ -0,0 +1,496 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * libbatmon - shared battery monitor core.  See libbatmon.h for the
+ * interface; the numbers and the estimator semantics mirror
+ * pi-battery.py and must stay in sync with it.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include "libbatmon.h"
+
+/* Configuration - keep in sync with pi-battery.py */
+#define BAT_CELLS               3
+#define BAT_CELL_CAPACITY_mAh   2600
+#define BAT_VOLTAGE_HIGH_mV     4128
+#define BAT_VOLTAGE_LOW_mV      3100
+#define BAT_FULL_CLAMP          99
+#define VOLTAGE_HYSTERESIS_mV   50
+
+#define I2C_ADDR                0x41
+
+#define INA_CALIBRATION         26868
+#define POWER_LSB_W             0.003048
+#define CURRENT_LSB_mA          0.1524
+
+#define CALIBRATION_FILE        "/var/lib/batmon/calibration_data"  /* default */
+
+#define AVG_WINDOW              20  /* default; see batmon_set_avg_window() */
+#define MAX_HISTORY             500
+
+#define CALIBRATION_INTERVAL_S  3600
+
+#define THRESHOLD_DISCHARGE_mV  (-3.0)
+#define THRESHOLD_CHARGE_mV     0.2
+
+/* Derived constants */
+#define BAT_CAPACITY_mAh        (BAT_CELLS * BAT_CELL_CAPACITY_mAh)
+#define BAT_VOLTAGE_FULL_mV     (BAT_VOLTAGE_HIGH_mV * BAT_CELLS)
+#define BAT_VOLTAGE_EMPTY_mV    (BAT_VOLTAGE_LOW_mV * BAT_CELLS)
+#define BAT_VOLTAGE_HYST_mV     (VOLTAGE_HYSTERESIS_mV * BAT_CELLS)
+
+/* INA219 registers */
+#define REG_CONFIG              0x00
+#define REG_SHUNTVOLTAGE        0x01
+#define REG_BUSVOLTAGE          0x02
+#define REG_POWER               0x03
+#define REG_CURRENT             0x04
+#define REG_CALIBRATION         0x05
+
+/*
+ * Rolling average over up to MAX_HISTORY samples, averaged only once
+ * `win` samples arrived - same semantics as HistAvg in pi-battery.py,
+ * O(1) per sample via an incremental sum.
+ */
+struct hist_avg {
+    double buf[MAX_HISTORY];
+    double sum;
+    int count;
+    int pos;
+    int win;
+};
+
+struct batmon {
+    struct hist_avg volt_hist;
+    struct hist_avg shunt_hist;
+    struct hist_avg curr_hist;
+    struct hist_avg power_hist;
+
+    long long dynamic_charge_full_uAh;
+    long long last_calibration_time;
+
+    char calibration_file[256];
+};
+
+static double
+hist_avg_add(struct hist_avg *h, double value)
+{
+    if (h->count == MAX_HISTORY)
+        h->sum -= h->buf[h->pos];
+    else
+        h->count++;
+
+    h->buf[h->pos] = value;
+    h->sum += value;
+    h->pos = (h->pos + 1) % MAX_HISTORY;
+
+    if (h->count >= h->win)
+        return h->sum / h->count;
+    return value;
+}
+
+static struct hist_avg *
+channel_hist(struct batmon *bm, int channel)
+{
+    switch (channel) {
+        case 0: return &bm->volt_hist;
+        case 1: return &bm->shunt_hist;
+        case 2: return &bm->curr_hist;
+        case 3: return &bm->power_hist;
+        default: return NULL;
+    }
+}
+
+/* ---------------- Dynamic full-capacity calibration ---------------- */
+
+static void
+load_calibration(struct batmon *bm)
+{
+    char line[128];
+    FILE *f = fopen(bm->calibration_file, "r");
+
+    if (!f)
+        return;
+
+    while (fgets(line, sizeof(line), f)) {
+        long long value;
+
+        if (sscanf(line, "DYNAMIC_CHARGE_FULL=%lld", &value) == 1)
+            bm->dynamic_charge_full_uAh = value;
+        else if (sscanf(line, "LAST_CALIBRATION_TIME=%lld", &value) == 1)
+            bm->last_calibration_time = value;
+    }
+    fclose(f);
+}
+
+static void
+save_calibration(const struct batmon *bm)
+{
+    char tmp[sizeof(bm->calibration_file) + 4];
+    char dir[sizeof(bm->calibration_file)];
+    char *slash;
+    FILE *f;
+
+    snprintf(dir, sizeof(dir), "%s", bm->calibration_file);
+    slash = strrchr(dir, '/');
+    if (slash && slash != dir) {
+        *slash = '\0';
+        mkdir(dir, 0755);
+    }
+    snprintf(tmp, sizeof(tmp), "%s.tmp", bm->calibration_file);
+
+    f = fopen(tmp, "w");
+    if (!f) {
+        fprintf(stderr, "WARN: Failed to save calibration: %s\n", strerror(errno));
+        return;
+    }
+    fprintf(f, "DYNAMIC_CHARGE_FULL=%lld\n", bm->dynamic_charge_full_uAh);
+    fprintf(f, "LAST_CALIBRATION_TIME=%lld\n", bm->last_calibration_time);
+    fclose(f);
+
+    if (rename(tmp, bm->calibration_file))
+        fprintf(stderr, "WARN: Failed to save calibration: %s\n", strerror(errno));
+}
+
+static void
+calibrate_if_full(struct batmon *bm, int voltage_mV, long long charge_now_uAh,
+        long long now_s)
+{
+    if (now_s - bm->last_calibration_time < CALIBRATION_INTERVAL_S)
+        return;
+
+    if (voltage_mV >= BAT_VOLTAGE_FULL_mV - BAT_VOLTAGE_HYST_mV &&
+            charge_now_uAh < bm->dynamic_charge_full_uAh) {
+        /* smooth update: 19:1 like the scripts */
+        bm->dynamic_charge_full_uAh =
+                (bm->dynamic_charge_full_uAh * 19 + charge_now_uAh) / 20;
+        bm->last_calibration_time = now_s;
+        save_calibration(bm);
+    }
+}
+
+/* ---------------- Estimator ---------------- */
+
+struct batmon *
+batmon_new(void)
+{
+    struct batmon *bm = calloc(1, sizeof(*bm));
+
+    if (!bm)
+        return NULL;
+
+    bm->volt_hist.win = AVG_WINDOW;
+    bm->shunt_hist.win = AVG_WINDOW;
+    bm->curr_hist.win = AVG_WINDOW;
+    bm->power_hist.win = AVG_WINDOW;
+
+    snprintf(bm->calibration_file, sizeof(bm->calibration_file), "%s",
+            CALIBRATION_FILE);
+    bm->dynamic_charge_full_uAh = (long long)BAT_CAPACITY_mAh * 1000;
+    load_calibration(bm);
+    return bm;
+}
+
+void
+batmon_set_calibration_file(struct batmon *bm, const char *path)
+{
+    snprintf(bm->calibration_file, sizeof(bm->calibration_file), "%s", path);
+
+    /* forget whatever the old file provided and reload from the new one */
+    bm->dynamic_charge_full_uAh = (long long)BAT_CAPACITY_mAh * 1000;
+    bm->last_calibration_time = 0;
+    load_calibration(bm);
+}
+
+void
+batmon_free(struct batmon *bm)
+{
+    free(bm);
+}
+
+void
+batmon_set_avg_window(struct batmon *bm, int window)
+{
+    int i;
+
+    if (window < 1)
+        window = 1;
+    for (i = 0; i < 4; i++)
+        channel_hist(bm, i)->win = window;
+}
+
+int
+batmon_get_channel(const struct batmon *bm, int channel, double *mean, int *count)
+{
+    const struct hist_avg *h = channel_hist((struct batmon *)bm, channel);
+
+    if (!h)
+        return -1;
+    *count = h->count;
+    *mean = h->count ? h->sum / h->count : 0.0;
+    return 0;
+}
+
+int
+batmon_restore_channel(struct batmon *bm, int channel, double mean, int count)
+{
+    struct hist_avg *h = channel_hist(bm, channel);
+    int i;
+
+    if (!h)
+        return -1;
+    if (count < 0)
+        count = 0;
+    if (count > MAX_HISTORY)
+        count = MAX_HISTORY;
+
+    for (i = 0; i < count; i++)
+        h->buf[i] = mean;
+    h->sum = mean * count;
+    h->count = count;
+    h->pos = count % MAX_HISTORY;
+    return 0;
+}
+
+static int
+soc_percent_from_voltage_mV(int v_mV)
+{
+    if (v_mV >= BAT_VOLTAGE_FULL_mV)
+        return 100;
+    if (v_mV <= BAT_VOLTAGE_EMPTY_mV)
+        return 0;
+    return (int)ceil((double)(v_mV - BAT_VOLTAGE_EMPTY_mV) * 100.0 /
+            (BAT_VOLTAGE_FULL_mV - BAT_VOLTAGE_EMPTY_mV));
+}
+
+static int
+status_from_shunt_mV(double shunt_mV)
+{
+    if (shunt_mV < THRESHOLD_DISCHARGE_mV)
+        return BATMON_STATUS_DISCHARGING;
+    if (shunt_mV > THRESHOLD_CHARGE_mV)
+        return BATMON_STATUS_CHARGING;
+    return BATMON_STATUS_FULL;
+}
+
+int
+batmon_step(struct batmon *bm, int bus_voltage_mV, double shunt_voltage_mV,
+        double current_A, double power_W, long long now_s,
+        struct batmon_result *out)
+{
+    out->bus_voltage_avg_mV =
+            (int)lround(hist_avg_add(&bm->volt_hist, bus_voltage_mV));
+    out->shunt_voltage_avg_mV =
+            hist_avg_add(&bm->shunt_hist, fabs(shunt_voltage_mV));
+    out->current_avg_A = hist_avg_add(&bm->curr_hist, fabs(current_A));
+    out->power_avg_W = hist_avg_add(&bm->power_hist, power_W);
+
+    out->status_int = status_from_shunt_mV(shunt_voltage_mV);
+
+    out->soc_pct = soc_percent_from_voltage_mV(out->bus_voltage_avg_mV);
+    out->charge_full_uAh = bm->dynamic_charge_full_uAh;
+    out->charge_now_uAh = out->charge_full_uAh * out->soc_pct / 100;
+    out->current_now_uA = (int)(fabs(current_A) * 1000000.0);
+    out->current_now_avg_uA = (int)(out->current_avg_A * 1000000.0);
+
+    calibrate_if_full(bm, bus_voltage_mV, out->charge_now_uAh, now_s);
+
+    /* Mobile-like behavior: clamp near 100% */
+    if (out->soc_pct >= 100 ||
+            (out->soc_pct >= BAT_FULL_CLAMP &&
+             out->status_int != BATMON_STATUS_DISCHARGING)) {
+        out->soc_pct = 100;
+        out->charge_now_uAh = out->charge_full_uAh;
+        out->current_now_uA = 1000;
+        out->status_int = BATMON_STATUS_FULL;
+    }
+
+    if (out->status_int == BATMON_STATUS_DISCHARGING && out->current_now_avg_uA > 0)
+        out->battery_remain_sec = (int)(out->charge_now_uAh * 3600 /
+                out->current_now_avg_uA);
+    else if (out->status_int == BATMON_STATUS_CHARGING && out->current_now_avg_uA > 0)
+        out->battery_remain_sec =
+                (int)((out->charge_full_uAh - out->charge_now_uAh) * 3600 /
+                out->current_now_avg_uA);
+    else
+        out->battery_remain_sec = 0;
+
+    return 0;
+}
+
+void
+batmon_fill_report(const struct batmon_result *res, int bus_voltage_mV,
+        struct pi_battery_report *out)
+{
+    out->voltage_min_design = BAT_VOLTAGE_EMPTY_mV * 1000;
+    out->voltage_now = bus_voltage_mV * 1000;
+    out->current_now = res->current_now_uA;
+    out->charge_full_design = BAT_CAPACITY_mAh * 1000;
+    out->charge_full = (int)res->charge_full_uAh;
+    out->charge_now = (int)res->charge_now_uAh;
+    out->capacity = res->soc_pct;
+    out->ac_status = res->status_int != BATMON_STATUS_DISCHARGING;
+}
+
+/* ---------------- INA219 access over /dev/i2c-N ---------------- */
+
+int
+batmon_i2c_open(int bus)
+{
+    char path[32];
+
+    snprintf(path, sizeof(path), "/dev/i2c-%d", bus);
+    return open(path, O_RDWR);
+}
+
+static int
+ina219_write_u16(int fd, unsigned char reg, unsigned int value)
+{
+    unsigned char buf[3] = { reg, (value >> 8) & 0xFF, value & 0xFF };
+    struct i2c_msg msg = {
+        .addr = I2C_ADDR,
+        .flags = 0,
+        .len = sizeof(buf),
+        .buf = buf,
+    };
+    struct i2c_rdwr_ioctl_data xfer = { .msgs = &msg, .nmsgs = 1 };
+
+    return ioctl(fd, I2C_RDWR, &xfer) < 0 ? -1 : 0;
+}
+
+int
+batmon_ina219_configure(int fd)
+{
+    /* Config: 16V range, 320mV shunt, 12bit x32 samples, continuous */
+    unsigned int config = (0x00 << 13) | (0x03 << 11) | (0x0D << 7) | (0x0D << 3) | 0x07;
+
+    if (ina219_write_u16(fd, REG_CALIBRATION, INA_CALIBRATION))
+        return -1;
+    return ina219_write_u16(fd, REG_CONFIG, config);
+}
+
+int
+batmon_ina219_read_all(int fd, int *bus_raw, int *shunt_raw,
+        int *current_raw, int *power_raw)
+{
+    unsigned char regs[4] = { REG_SHUNTVOLTAGE, REG_BUSVOLTAGE, REG_POWER, REG_CURRENT };
+    unsigned char data[4][2];
+    struct i2c_msg msgs[8];
+    struct i2c_rdwr_ioctl_data xfer = { .msgs = msgs, .nmsgs = 8 };
+    unsigned int raw[4];
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        msgs[2 * i].addr = I2C_ADDR;
+        msgs[2 * i].flags = 0;
+        msgs[2 * i].len = 1;
+        msgs[2 * i].buf = &regs[i];
+
+        msgs[2 * i + 1].addr = I2C_ADDR;
+        msgs[2 * i + 1].flags = I2C_M_RD;
+        msgs[2 * i + 1].len = 2;
+        msgs[2 * i + 1].buf = data[i];
+    }
+
+    if (ioctl(fd, I2C_RDWR, &xfer) < 0)
+        return -1;
+
+    for (i = 0; i < 4; i++)
+        raw[i] = (data[i][0] << 8) | data[i][1];
+
+    *shunt_raw = (raw[0] & 0x8000) ? (int)raw[0] - 0x10000 : (int)raw[0];
+    *bus_raw = raw[1];
+    *power_raw = (raw[2] & 0x8000) ? (int)raw[2] - 0x10000 : (int)raw[2];
+    *current_raw = (raw[3] & 0x8000) ? (int)raw[3] - 0x10000 : (int)raw[3];
+    return 0;
+}
+
+int
+batmon_decode_bus_mV(int bus_raw)
+{
+    return ((bus_raw >> 3) & 0x1FFF) * 4;
+}
+
+double
+batmon_decode_shunt_mV(int shunt_raw)
+{
+    return shunt_raw * 0.01;
+}
+
+double
+batmon_decode_current_A(int current_raw)
+{
+    return current_raw * CURRENT_LSB_mA / 1000.0;
+}
+
+double
+batmon_decode_power_W(int power_raw)
+{
+    return power_raw * POWER_LSB_W;
+}
+
+/* ---------------- /dev/pi_battery output ---------------- */
+
+int
+batmon_format_report(const struct pi_battery_report *report, char *buf, int len)
+{
+    return snprintf(buf, len,
+            "voltage_min_design=%d\n"
+            "voltage_now=%d\n"
+            "current_now=%d\n"
+            "charge_full_design=%d\n"
+            "charge_full=%d\n"
+            "charge_now=%d\n"
+            "capacity=%d\n"
+            "charging=%d\n",
+            report->voltage_min_design, report->voltage_now,
+            report->current_now, report->charge_full_design,
+            report->charge_full, report->charge_now,
+            report->capacity, report->ac_status);
+}
+
+int
+batmon_write_batfile(int fd, const struct pi_battery_report *report)
+{
+    static int use_text = 0;
+    char buf[512];
+    int len;
+
+    if (!use_text) {
+        if (ioctl(fd, PI_BATTERY_SET_ALL, report) == 0)
+            return 0;
+        if (errno != ENOTTY && errno != EINVAL)
+            return -1;
+        /* module predates the binary interface */
+        use_text = 1;
+    }
+
+    len = batmon_format_report(report, buf, sizeof(buf));
+    return write(fd, buf, len) == len ? 0 : -1;
+}
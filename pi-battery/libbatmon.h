@@ -0,0 +1,136 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * libbatmon - the one shared implementation of the battery monitor:
+ * INA219 access and register decoding, rolling statistics, SoC math
+ * with dynamic full-capacity calibration, and /dev/pi_battery output.
+ *
+ * Front-ends stay thin: pi-battery-daemon and batmon-cli link this
+ * directly, and the Python daemon can call it through ctypes (every
+ * entry point uses plain C types, no callbacks, no varargs).
+ */
+
+#ifndef LIBBATMON_H
+#define LIBBATMON_H
+
+#include "pi-battery.h"
+
+/* Battery status as encoded by the estimator (not POWER_SUPPLY_*) */
+#define BATMON_STATUS_FULL          0
+#define BATMON_STATUS_CHARGING      1
+#define BATMON_STATUS_DISCHARGING   2
+
+/* Everything one estimator step produces; raw inputs stay the caller's. */
+struct batmon_result {
+    int bus_voltage_avg_mV;
+    double shunt_voltage_avg_mV;
+    double current_avg_A;
+    double power_avg_W;
+    int soc_pct;
+    long long charge_full_uAh;
+    long long charge_now_uAh;
+    int current_now_uA;
+    int current_now_avg_uA;
+    int status_int;          /* BATMON_STATUS_* */
+    int battery_remain_sec;  /* 0 when full or unknown */
+};
+
+struct batmon;  /* opaque estimator context */
+
+/* ---- estimator lifecycle ---- */
+
+/* Allocates a context and loads persisted calibration, if any. */
+struct batmon *batmon_new(void);
+void batmon_free(struct batmon *bm);
+
+/*
+ * Redirects calibration persistence away from the default
+ * /var/lib/batmon/calibration_data, discarding previously loaded state
+ * and reloading from the new path.  Tools replaying synthetic data
+ * (the estimator simulator) use this so they never write the live
+ * calibration.
+ */
+void batmon_set_calibration_file(struct batmon *bm, const char *path);
+
+/*
+ * Overrides the rolling-average window on all channels.  The default
+ * (20 samples) suits the continuous x32 configuration the C front-ends
+ * run; pi-battery.py runs x128 hardware averaging bridged by a
+ * 3-sample window and sets that here, so the native path warms up in
+ * seconds instead of 40 s.
+ */
+void batmon_set_avg_window(struct batmon *bm, int window);
+
+/*
+ * Rolling-window state for warm restarts, channel-indexed 0 = voltage,
+ * 1 = shunt, 2 = current, 3 = power (the order pi-battery.py
+ * checkpoints them in).  get reads the current mean and sample count;
+ * restore rebuilds a converged window from a saved pair, and count 0
+ * clears the channel.  Both return -1 on a bad channel index.
+ */
+int batmon_get_channel(const struct batmon *bm, int channel,
+        double *mean, int *count);
+int batmon_restore_channel(struct batmon *bm, int channel,
+        double mean, int count);
+
+/*
+ * One estimator cycle from already-decoded measurements: feeds the
+ * rolling windows, derives SoC/status/remaining time, applies the
+ * near-full clamp and runs the hourly calibration (persisting it
+ * itself).  Returns 0 and fills *out.
+ */
+int batmon_step(struct batmon *bm, int bus_voltage_mV, double shunt_voltage_mV,
+        double current_A, double power_W, long long now_s,
+        struct batmon_result *out);
+
+/* Renders a result as the report submitted to the kernel module; the
+ * raw (unaveraged) bus voltage becomes voltage_now, like the scripts. */
+void batmon_fill_report(const struct batmon_result *res, int bus_voltage_mV,
+        struct pi_battery_report *out);
+
+/* ---- INA219 transport and register decoding ---- */
+
+/* Returns an open /dev/i2c-N fd, or -1 with errno set. */
+int batmon_i2c_open(int bus);
+
+/* Calibrates and configures the INA219 (continuous mode). */
+int batmon_ina219_configure(int fd);
+
+/*
+ * Reads shunt voltage, bus voltage, power and current in one I2C_RDWR
+ * message chain (repeated starts, no stop between registers), so all
+ * four values belong to the same instant on the bus.
+ */
+int batmon_ina219_read_all(int fd, int *bus_raw, int *shunt_raw,
+        int *current_raw, int *power_raw);
+
+int batmon_decode_bus_mV(int bus_raw);
+double batmon_decode_shunt_mV(int shunt_raw);
+double batmon_decode_current_A(int current_raw);
+double batmon_decode_power_W(int power_raw);
+
+/* ---- /dev/pi_battery output ---- */
+
+/* Formats the text-protocol block into buf; returns its length. */
+int batmon_format_report(const struct pi_battery_report *report, char *buf, int len);
+
+/*
+ * Submits a report, preferring the PI_BATTERY_SET_ALL ioctl and falling
+ * back to the text protocol on modules that predate it.
+ */
+int batmon_write_batfile(int fd, const struct pi_battery_report *report);
+
+#endif
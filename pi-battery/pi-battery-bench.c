@@ -0,0 +1,223 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * pi-battery-bench - microbenchmark for the /dev/pi_battery control path
+ *
+ * Measures, with p50/p99 latency and throughput:
+ *   (a) text-protocol writes of a representative key=value block
+ *   (b) binary PI_BATTERY_SET_ALL ioctl submissions
+ *   (c) bulk sysfs property reads of BAT0
+ *
+ * Build with `make bench` and run as root on a deck with the module
+ * loaded.  Useful to quantify control-path changes and to catch
+ * regressions after an Armbian kernel bump.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+
+#include "pi-battery.h"
+
+#define BATFILE     "/dev/pi_battery"
+#define SYSFS_BAT   "/sys/class/power_supply/BAT0"
+#define DEFAULT_ITERATIONS 10000
+
+static const char *sysfs_properties[] = {
+    "status", "voltage_min_design", "voltage_now", "current_now",
+    "charge_full_design", "charge_full", "charge_now", "capacity",
+    "capacity_level", "present", "health", "technology",
+};
+
+static const char text_block[] =
+    "voltage_min_design=9300000\n"
+    "voltage_now=11800000\n"
+    "current_now=512000\n"
+    "charge_full_design=7800000\n"
+    "charge_full=7500000\n"
+    "charge_now=5200000\n"
+    "capacity=69\n"
+    "charging=0\n";
+
+static long long
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int
+compare_ll(const void *a, const void *b)
+{
+    long long d = *(const long long *)a - *(const long long *)b;
+    return d < 0 ? -1 : d > 0;
+}
+
+static void
+report(const char *name, long long *lat, int n)
+{
+    long long total = 0;
+    int i;
+
+    qsort(lat, n, sizeof(*lat), compare_ll);
+    for (i = 0; i < n; i++)
+        total += lat[i];
+
+    printf("%-24s %8d ops  p50 %7.2f us  p99 %7.2f us  %10.0f ops/s\n",
+            name, n,
+            lat[n / 2] / 1000.0,
+            lat[(int)(n * 0.99)] / 1000.0,
+            n / (total / 1e9));
+}
+
+static int
+bench_text_write(int fd, long long *lat, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        long long t0 = now_ns();
+
+        if (write(fd, text_block, sizeof(text_block) - 1) < 0) {
+            perror("write " BATFILE);
+            return -1;
+        }
+        lat[i] = now_ns() - t0;
+    }
+    return 0;
+}
+
+static int
+bench_ioctl_write(int fd, long long *lat, int n)
+{
+    struct pi_battery_report report = {
+        .voltage_min_design = 9300000,
+        .voltage_now = 11800000,
+        .current_now = 512000,
+        .charge_full_design = 7800000,
+        .charge_full = 7500000,
+        .charge_now = 5200000,
+        .capacity = 69,
+        .ac_status = 0,
+    };
+    int i;
+
+    for (i = 0; i < n; i++) {
+        long long t0 = now_ns();
+
+        if (ioctl(fd, PI_BATTERY_SET_ALL, &report) < 0) {
+            if (errno == ENOTTY || errno == EINVAL)
+                fprintf(stderr, "module has no PI_BATTERY_SET_ALL, skipping ioctl bench\n");
+            else
+                perror("ioctl " BATFILE);
+            return -1;
+        }
+        lat[i] = now_ns() - t0;
+    }
+    return 0;
+}
+
+/* One "refresh": open/read/close every BAT0 property, like a widget does. */
+static int
+bench_sysfs_read(long long *lat, int n)
+{
+    char path[128], buf[64];
+    unsigned int p;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        long long t0 = now_ns();
+
+        for (p = 0; p < sizeof(sysfs_properties) / sizeof(*sysfs_properties); p++) {
+            int fd;
+
+            snprintf(path, sizeof(path), SYSFS_BAT "/%s", sysfs_properties[p]);
+            fd = open(path, O_RDONLY);
+            if (fd < 0) {
+                fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+                return -1;
+            }
+            if (read(fd, buf, sizeof(buf)) < 0) {
+                perror(path);
+                close(fd);
+                return -1;
+            }
+            close(fd);
+        }
+        lat[i] = now_ns() - t0;
+    }
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    int iterations = DEFAULT_ITERATIONS;
+    long long *lat;
+    int fd, opt;
+
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n iterations]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (iterations <= 0) {
+        fprintf(stderr, "iteration count must be positive\n");
+        return 1;
+    }
+
+    lat = malloc(iterations * sizeof(*lat));
+    if (!lat) {
+        perror("malloc");
+        return 1;
+    }
+
+    fd = open(BATFILE, O_WRONLY);
+    if (fd < 0) {
+        fprintf(stderr, "cannot open %s: %s (is the module loaded?)\n",
+                BATFILE, strerror(errno));
+        return 1;
+    }
+
+    printf("pi-battery control path benchmark, %d iterations per case\n\n", iterations);
+
+    if (bench_text_write(fd, lat, iterations) == 0)
+        report("text write", lat, iterations);
+
+    if (bench_ioctl_write(fd, lat, iterations) == 0)
+        report("PI_BATTERY_SET_ALL", lat, iterations);
+
+    if (bench_sysfs_read(lat, iterations) == 0)
+        report("sysfs full refresh", lat, iterations);
+
+    close(fd);
+    free(lat);
+    return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * pi-battery-daemon - native INA219 battery monitor
+ *
+ * Compiled counterpart of pi-battery.py: reads the INA219 over
+ * /dev/i2c-N, runs the same averaging / SoC / dynamic-calibration logic
+ * and pushes the result into the pi_battery kernel module, preferring
+ * the binary PI_BATTERY_SET_ALL ioctl and falling back to the text
+ * protocol on older modules.  No interpreter, a few hundred kB RSS and
+ * a cold start well under 100 ms, so the first battery reading is on
+ * screen right after boot.
+ *
+ * All the measuring and estimating lives in libbatmon; this file is
+ * just the service loop around it.
+ *
+ * Set DEBUG=1 in the environment for per-cycle diagnostics on stdout.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libbatmon.h"
+
+#define I2C_BUS                 2
+#define BATFILE                 "/dev/pi_battery"
+#define SAMPLE_PERIOD_S         2
+
+static volatile sig_atomic_t running = 1;
+
+static void
+handle_signal(int sig)
+{
+    (void)sig;
+    running = 0;
+}
+
+int
+main(void)
+{
+    struct batmon *bm;
+    int debug = getenv("DEBUG") && !strcmp(getenv("DEBUG"), "1");
+    int i2c_fd, bat_fd;
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    i2c_fd = batmon_i2c_open(I2C_BUS);
+    if (i2c_fd < 0) {
+        fprintf(stderr, "ERROR: cannot open /dev/i2c-%d: %s\n",
+                I2C_BUS, strerror(errno));
+        return 1;
+    }
+
+    if (batmon_ina219_configure(i2c_fd)) {
+        fprintf(stderr, "ERROR: INA219 configuration failed: %s\n", strerror(errno));
+        return 1;
+    }
+
+    bat_fd = open(BATFILE, O_WRONLY);
+    if (bat_fd < 0)
+        fprintf(stderr, "WARN: BATFILE %s not found\n", BATFILE);
+
+    bm = batmon_new();
+    if (!bm)
+        return 1;
+
+    sleep(1);
+
+    while (running) {
+        struct batmon_result res;
+        struct pi_battery_report report;
+        int bus_raw, shunt_raw, current_raw, power_raw;
+        int bus_voltage_mV;
+        double shunt_voltage_mV, current_A, power_W;
+
+        if (batmon_ina219_read_all(i2c_fd, &bus_raw, &shunt_raw,
+                &current_raw, &power_raw)) {
+            fprintf(stderr, "WARN: I2C read failed: %s\n", strerror(errno));
+            sleep(SAMPLE_PERIOD_S);
+            continue;
+        }
+
+        bus_voltage_mV = batmon_decode_bus_mV(bus_raw);
+        shunt_voltage_mV = batmon_decode_shunt_mV(shunt_raw);
+        current_A = batmon_decode_current_A(current_raw);
+        power_W = batmon_decode_power_W(power_raw);
+
+        batmon_step(bm, bus_voltage_mV, shunt_voltage_mV, current_A, power_W,
+                (long long)time(NULL), &res);
+
+        batmon_fill_report(&res, bus_voltage_mV, &report);
+
+        if (bat_fd >= 0 && batmon_write_batfile(bat_fd, &report))
+            fprintf(stderr, "WARN: Failed to write BATFILE: %s\n", strerror(errno));
+
+        if (debug) {
+            printf("bus_voltage: %d mV (avg %d mV)\n",
+                    bus_voltage_mV, res.bus_voltage_avg_mV);
+            printf("shunt_voltage: %.3f mV (avg %.3f mV)\n",
+                    shunt_voltage_mV, res.shunt_voltage_avg_mV);
+            printf("current: %.6f A (avg %.6f A)\n", current_A, res.current_avg_A);
+            printf("power: %.3f W (avg %.3f W)\n", power_W, res.power_avg_W);
+            printf("capacity: %d %%, status: %d, charge_now: %lld uAh\n\n",
+                    res.soc_pct, res.status_int, res.charge_now_uAh);
+        }
+
+        sleep(SAMPLE_PERIOD_S);
+    }
+
+    batmon_free(bm);
+    if (bat_fd >= 0)
+        close(bat_fd);
+    close(i2c_fd);
+    return 0;
+}
@@ -0,0 +1,205 @@
+#!/usr/bin/env python3
+"""
+Register-trace simulator and benchmark for the BatteryEstimator.
+
+Feeds recorded or synthetic INA219 register sequences (bus/shunt/
+current/power raw values) through BatteryEstimator.step() at maximum
+speed, so estimator tuning (AVG_WINDOW, hysteresis, clamp logic) takes
+seconds instead of hours of wall-clock battery time, and changes get a
+throughput number attached.
+
+Usage:
+    pi-battery-sim.py                      # synthetic full discharge
+    pi-battery-sim.py --hours 6 --noise 20
+    pi-battery-sim.py --trace FILE         # CSV: bus_raw,shunt_raw,
+                                           #   current_raw,power_raw[,soc]
+    pi-battery-sim.py --coulomb            # coulomb-counting mode
+    pi-battery-sim.py --native             # benchmark the libbatmon path
+
+Reports mean/max SoC error and convergence time against ground truth
+(when the trace has one) plus samples/second through step().
+"""
+import argparse
+import csv
+import os
+import sys
+import tempfile
+import time
+import types
+import importlib.util
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+# INA219 LSBs - keep in sync with pi-battery.py
+SHUNT_LSB_mV = 0.01
+CURRENT_LSB_mA = 0.1524
+POWER_LSB_W = 0.003048
+
+CONVERGED_PCT = 2  # SoC error considered "settled" below this
+
+
+class SimClock:
+    """Stand-in for pi-battery.py's time module: the coulomb counter and
+    the calibration/checkpoint timers integrate real time, which a
+    max-speed replay does not spend, so the simulator advances this
+    clock by one sample period per step instead."""
+
+    def __init__(self, start_s=1_000_000.0):
+        self.now_s = start_s
+
+    def advance(self, dt_s):
+        self.now_s += dt_s
+
+    def time(self):
+        return self.now_s
+
+    def monotonic_ns(self):
+        return int(self.now_s * 1e9)
+
+
+def load_estimator_module():
+    """Import pi-battery.py (dash in the name, so no plain import) with
+    smbus2 stubbed out - the simulator never touches the bus."""
+    if "smbus2" not in sys.modules:
+        stub = types.ModuleType("smbus2")
+        stub.SMBus = object
+        stub.i2c_msg = object
+        sys.modules["smbus2"] = stub
+
+    spec = importlib.util.spec_from_file_location(
+        "pi_battery", os.path.join(HERE, "pi-battery.py"))
+    mod = importlib.util.module_from_spec(spec)
+    sys.modules["pi_battery"] = mod
+    spec.loader.exec_module(mod)
+    return mod
+
+
+def synthetic_trace(mod, hours, period_s, noise_uV):
+    """Linear full discharge with measurement noise; ground truth is the
+    linear SoC in time.  Yields (bus_raw, shunt_raw, current_raw,
+    power_raw, truth_soc)."""
+    import random
+
+    rng = random.Random(42)  # reproducible runs
+    n = max(2, int(hours * 3600 / period_s))
+    v_full = mod.BAT_VOLTAGE_FULL_mV
+    v_empty = mod.BAT_VOLTAGE_EMPTY_mV
+    draw_A = (mod.BAT_CAPACITY_mAh / 1000.0) / hours  # C-rate for the span
+
+    for i in range(n):
+        frac = i / (n - 1)
+        truth_soc = round((1.0 - frac) * 100)
+        bus_mV = v_full - (v_full - v_empty) * frac
+        bus_mV += rng.gauss(0, noise_uV / 1000.0)
+
+        current_A = -draw_A + rng.gauss(0, draw_A * 0.05)
+        shunt_mV = current_A * 10.0  # 0.01 ohm shunt, A -> mV
+        power_W = abs(current_A) * bus_mV / 1000.0
+
+        bus_raw = (max(0, int(bus_mV / 4)) & 0x1FFF) << 3
+        shunt_raw = int(shunt_mV / SHUNT_LSB_mV)
+        current_raw = int(current_A * 1000 / CURRENT_LSB_mA)
+        power_raw = int(power_W / POWER_LSB_W)
+        yield bus_raw, shunt_raw, current_raw, power_raw, truth_soc
+
+
+def file_trace(path):
+    with open(path, newline="") as f:
+        for row in csv.reader(f):
+            if not row or row[0].lstrip().startswith("#"):
+                continue
+            vals = [int(float(x)) for x in row]
+            truth = vals[4] if len(vals) > 4 else None
+            yield vals[0], vals[1], vals[2], vals[3], truth
+
+
+def decode(raw):
+    bus_raw, shunt_raw, current_raw, power_raw, truth = raw
+    bus_mV = ((bus_raw >> 3) & 0x1FFF) * 4
+    shunt_mV = shunt_raw * SHUNT_LSB_mV
+    current_A = current_raw * CURRENT_LSB_mA / 1000.0
+    power_W = power_raw * POWER_LSB_W
+    return bus_mV, shunt_mV, current_A, power_W, truth
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    ap.add_argument("--trace", help="CSV register trace instead of synthetic data")
+    ap.add_argument("--hours", type=float, default=4.0,
+                    help="synthetic discharge duration (default 4)")
+    ap.add_argument("--period", type=float, default=2.0,
+                    help="simulated sample period in seconds (default 2)")
+    ap.add_argument("--noise", type=float, default=10.0,
+                    help="synthetic bus-voltage noise in mV RMS (default 10)")
+    ap.add_argument("--coulomb", action="store_true",
+                    help="run the coulomb-counting estimator mode")
+    ap.add_argument("--native", action="store_true",
+                    help="benchmark the libbatmon fast path (off by default)")
+    args = ap.parse_args()
+
+    mod = load_estimator_module()
+    mod.COULOMB_COUNTING = args.coulomb
+    clock = SimClock()
+    mod.time = clock  # estimator time flows at one period per sample
+
+    # keep simulation runs off the real calibration/checkpoint state
+    scratch = tempfile.mkdtemp(prefix="batmon-sim-")
+    mod.CALIBRATION_FILE = os.path.join(scratch, "calibration_data")
+    mod.CHECKPOINT_FILE = os.path.join(scratch, "estimator_checkpoint")
+
+    est = mod.BatteryEstimator()
+    # Native is opt-in here: the Python-global redirect above does not
+    # reach libbatmon, which persists calibration itself - a default sim
+    # run must never be able to write the live /var/lib/batmon state.
+    if getattr(est, "_native", None):
+        if args.native:
+            est._lib.batmon_set_calibration_file(
+                est._native,
+                os.path.join(scratch, "calibration_data").encode())
+        else:
+            est._native = None
+    native = bool(getattr(est, "_native", None))
+
+    trace = list(file_trace(args.trace) if args.trace else
+                 synthetic_trace(mod, args.hours, args.period, args.noise))
+    if not trace:
+        sys.exit("ERROR: empty trace")
+
+    errors = []
+    converged_at = None
+    t0 = time.perf_counter()
+    for i, raw in enumerate(trace):
+        bus_mV, shunt_mV, current_A, power_W, truth = decode(raw)
+        out = est.step(bus_mV, shunt_mV, current_A, power_W)
+        clock.advance(args.period)
+        if truth is not None:
+            err = abs(out["soc_pct"] - truth)
+            errors.append(err)
+            if err <= CONVERGED_PCT and converged_at is None:
+                converged_at = i
+            elif err > CONVERGED_PCT:
+                converged_at = None
+    elapsed = time.perf_counter() - t0
+
+    n = len(trace)
+    mode = "coulomb" if args.coulomb else "voltage"
+    path = "libbatmon (native)" if native else "pure Python"
+    print(f"estimator:        {mode} mode, {path}")
+    print(f"samples:          {n} "
+          f"({n * args.period / 3600:.1f} h simulated at {args.period:.2f} s)")
+    print(f"throughput:       {n / elapsed:,.0f} samples/s "
+          f"({elapsed * 1e6 / n:.1f} us/step)")
+    if errors:
+        mean_err = sum(errors) / len(errors)
+        print(f"SoC error:        mean {mean_err:.2f} %, max {max(errors)} %")
+        if converged_at is not None:
+            print(f"convergence:      stayed within {CONVERGED_PCT} % from sample "
+                  f"{converged_at} ({converged_at * args.period:.0f} s simulated)")
+        else:
+            print(f"convergence:      never settled within {CONVERGED_PCT} %")
+    else:
+        print("SoC error:        n/a (trace has no ground-truth column)")
+
+
+if __name__ == "__main__":
+    main()
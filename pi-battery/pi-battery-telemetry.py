@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""
+Reader for the binary telemetry ring written by pi-battery.py.
+
+Usage:
+    pi-battery-telemetry.py dump  [file]   # records oldest-first as CSV
+    pi-battery-telemetry.py stats [file]   # per-channel summary
+
+The record and header layouts must match TelemetryRing in pi-battery.py.
+Auxiliary rails (EXTRA_RAILS) log to /var/lib/batmon/telemetry-<name>.ring
+in the same format; pass the path to read them (SoC/status are 0 there).
+"""
+import os
+import struct
+import sys
+from datetime import datetime
+
+TELEMETRY_FILE = "/var/lib/batmon/telemetry.ring"
+
+MAGIC = 0x31544D42  # "BMT1"
+# magic, record_size, capacity, head, total
+HEADER = struct.Struct("<IIIIQ")
+# timestamp_s, bus_mV, shunt_uV, current_uA, power_mW, soc_pct, status
+RECORD = struct.Struct("<QiiiiII")
+
+STATUS_MAP = {0: "Full", 1: "Charging", 2: "Discharging"}
+
+
+def read_records(path):
+    with open(path, "rb") as f:
+        data = f.read()
+
+    magic, record_size, capacity, head, total = HEADER.unpack_from(data, 0)
+    if magic != MAGIC:
+        sys.exit(f"ERROR: {path} is not a telemetry ring (bad magic)")
+    if record_size != RECORD.size:
+        sys.exit(f"ERROR: {path} uses record size {record_size}, expected {RECORD.size}")
+
+    count = min(total, capacity)
+    records = []
+    # oldest record sits right after head once the ring has wrapped
+    start = (head + 1) % capacity if total > capacity else 0
+    for i in range(count):
+        idx = (start + i) % capacity
+        records.append(RECORD.unpack_from(data, HEADER.size + idx * record_size))
+    return records
+
+
+def dump(records):
+    print("timestamp,bus_mV,shunt_mV,current_A,power_W,capacity_pct,status")
+    for ts, bus_mV, shunt_uV, current_uA, power_mW, soc, status in records:
+        t = datetime.fromtimestamp(ts).strftime("%Y-%m-%d %H:%M:%S")
+        print(f"{t},{bus_mV},{shunt_uV / 1000:.3f},{current_uA / 1e6:.6f},"
+              f"{power_mW / 1000:.3f},{soc},{STATUS_MAP.get(status, status)}")
+
+
+def stats(records):
+    if not records:
+        print("No records.")
+        return
+
+    span_s = records[-1][0] - records[0][0]
+    volts = [r[1] for r in records]
+    currents = [abs(r[3]) / 1e6 for r in records]
+    powers = [r[4] / 1000 for r in records]
+
+    print(f"Records:   {len(records)}")
+    print(f"Span:      {span_s / 3600:.1f} h "
+          f"({datetime.fromtimestamp(records[0][0])} .. {datetime.fromtimestamp(records[-1][0])})")
+    print(f"Voltage:   min {min(volts)} mV, max {max(volts)} mV, avg {sum(volts) // len(volts)} mV")
+    print(f"Current:   min {min(currents):.3f} A, max {max(currents):.3f} A, "
+          f"avg {sum(currents) / len(currents):.3f} A")
+    print(f"Power:     min {min(powers):.2f} W, max {max(powers):.2f} W, "
+          f"avg {sum(powers) / len(powers):.2f} W")
+    print(f"Capacity:  min {min(r[5] for r in records)} %, max {max(r[5] for r in records)} %")
+
+
+def main():
+    if len(sys.argv) < 2 or sys.argv[1] not in ("dump", "stats"):
+        print(__doc__.strip(), file=sys.stderr)
+        sys.exit(1)
+
+    path = sys.argv[2] if len(sys.argv) > 2 else TELEMETRY_FILE
+    if not os.path.exists(path):
+        sys.exit(f"ERROR: {path} does not exist")
+
+    records = read_records(path)
+    if sys.argv[1] == "dump":
+        dump(records)
+    else:
+        stats(records)
+
+
+if __name__ == "__main__":
+    main()
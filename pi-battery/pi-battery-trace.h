@@ -0,0 +1,115 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Tracepoints of the pi_battery module.  Compiled-out to a static branch
+ * when tracing is off, so instrumenting the hot paths costs nothing in
+ * normal operation.  With ftrace:
+ *
+ *   echo 1 > /sys/kernel/tracing/events/pi_battery/enable
+ *   cat /sys/kernel/tracing/trace_pipe
+ *
+ * The trace clock provides the timestamps, so end-to-end update latency
+ * is the distance between a pi_battery_update event and the following
+ * pi_battery_get_property events of the consumers.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM pi_battery
+
+#if !defined(PI_BATTERY_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define PI_BATTERY_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* A snapshot was committed from the text, ioctl or batch write path. */
+TRACE_EVENT(pi_battery_update,
+    TP_PROTO(int status, int capacity, int voltage_now, int current_now,
+        int ac, bool notify),
+
+    TP_ARGS(status, capacity, voltage_now, current_now, ac, notify),
+
+    TP_STRUCT__entry(
+        __field(int, status)
+        __field(int, capacity)
+        __field(int, voltage_now)
+        __field(int, current_now)
+        __field(int, ac)
+        __field(bool, notify)
+    ),
+
+    TP_fast_assign(
+        __entry->status = status;
+        __entry->capacity = capacity;
+        __entry->voltage_now = voltage_now;
+        __entry->current_now = current_now;
+        __entry->ac = ac;
+        __entry->notify = notify;
+    ),
+
+    TP_printk("status=%d capacity=%d voltage_now=%d current_now=%d ac=%d notify=%d",
+        __entry->status, __entry->capacity, __entry->voltage_now,
+        __entry->current_now, __entry->ac, __entry->notify)
+);
+
+/* A sysfs/power_supply consumer read one property. */
+TRACE_EVENT(pi_battery_get_property,
+    TP_PROTO(int psp, int intval),
+
+    TP_ARGS(psp, intval),
+
+    TP_STRUCT__entry(
+        __field(int, psp)
+        __field(int, intval)
+    ),
+
+    TP_fast_assign(
+        __entry->psp = psp;
+        __entry->intval = intval;
+    ),
+
+    TP_printk("psp=%d intval=%d", __entry->psp, __entry->intval)
+);
+
+/* The delta gate opened and power_supply_changed() is about to fire. */
+TRACE_EVENT(pi_battery_notify,
+    TP_PROTO(int status, int capacity, int ac),
+
+    TP_ARGS(status, capacity, ac),
+
+    TP_STRUCT__entry(
+        __field(int, status)
+        __field(int, capacity)
+        __field(int, ac)
+    ),
+
+    TP_fast_assign(
+        __entry->status = status;
+        __entry->capacity = capacity;
+        __entry->ac = ac;
+    ),
+
+    TP_printk("status=%d capacity=%d ac=%d",
+        __entry->status, __entry->capacity, __entry->ac)
+);
+
+#endif
+
+/* This part must stay outside the protection - see define_trace.h. */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE pi-battery-trace
+#include <trace/define_trace.h>
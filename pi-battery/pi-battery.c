@@ -16,14 +16,31 @@
 /* Based heavily on https://git.kernel.org/cgit/linux/kernel/git/stable/linux-stable.git/tree/drivers/power/test_power.c?id=refs/tags/v4.2.6 */
 
 #include <linux/fs.h>
+#include <linux/i2c.h>
 #include <linux/kernel.h>
+#include <linux/kobject.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/miscdevice.h>
+#include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
 #include <linux/power_supply.h>
+#include <linux/seqlock.h>
+#include <linux/slab.h>
 #include <linux/string.h>
+#include <linux/version.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 
 #include <asm/uaccess.h>
 
+#include "pi-battery.h"
+
+#define CREATE_TRACE_POINTS
+#include "pi-battery-trace.h"
+
 static int
 pi_battery_get_property(struct power_supply *psy,
         enum power_supply_property psp,
@@ -58,6 +75,55 @@ static struct battery_status {
 
 static int ac_status = 1;
 
+/*
+ * Guards pi_battery_status and ac_status.  Writers (control device
+ * updates) serialize on the lock; property readers stay lock-free and
+ * retry if a write raced them, so a sysfs walk over several properties
+ * always sees one consistent snapshot instead of a half-applied update.
+ */
+static DEFINE_SEQLOCK(status_lock);
+
+/*
+ * Serializes whole commits against each other.  The seqlock only covers
+ * the snapshot swap; the ring push, update_count, the last_notified
+ * bookkeeping and the notification itself must not interleave between
+ * concurrent committers (userspace writes, the ioctl and the in-kernel
+ * sampler), and the notify path may sleep, so this has to be a mutex.
+ */
+static DEFINE_MUTEX(commit_lock);
+
+/*
+ * When the last userspace-driven commit landed (0 = never), guarded by
+ * commit_lock.  The in-kernel INA219 sampler consults this to stand
+ * down while a userspace monitor is alive, instead of fighting it over
+ * the snapshot with a second estimate every poll.
+ */
+static u64 last_userspace_commit_ns;
+
+/*
+ * Notification gating: every committed write refreshes the readable
+ * values, but uevents are only fired when something meaningful changed,
+ * to avoid waking udevd/upower/applets every 2 seconds for identical
+ * data.  Voltage/current jitter below these deltas is not "meaningful".
+ */
+static int notify_delta_uv = 50000;
+module_param(notify_delta_uv, int, 0644);
+MODULE_PARM_DESC(notify_delta_uv, "minimum voltage_now change (in uV) worth a uevent");
+
+static int notify_delta_ua = 50000;
+module_param(notify_delta_ua, int, 0644);
+MODULE_PARM_DESC(notify_delta_ua, "minimum current_now change (in uA) worth a uevent");
+
+static struct battery_status last_notified;
+static int last_notified_ac = -1;   /* forces the first notification */
+
+/*
+ * Integer EWMA (1/8 weight) of |current_now|, updated on every commit
+ * and used to derive time-to-empty/time-to-full without floating point
+ * or a userspace round trip.  Guarded by status_lock like the rest.
+ */
+static int current_avg_ua;
+
 static char *pi_ac_supplies[] = {
     "BAT0",
 };
@@ -72,7 +138,9 @@ static enum power_supply_property pi_battery_properties[] = {
     POWER_SUPPLY_PROP_CHARGE_NOW,
     POWER_SUPPLY_PROP_CAPACITY,
     POWER_SUPPLY_PROP_CAPACITY_LEVEL,
-    
+    POWER_SUPPLY_PROP_TIME_TO_EMPTY_NOW,
+    POWER_SUPPLY_PROP_TIME_TO_FULL_NOW,
+
     POWER_SUPPLY_PROP_CHARGE_TYPE,
     POWER_SUPPLY_PROP_HEALTH,
     POWER_SUPPLY_PROP_PRESENT,
@@ -116,9 +184,57 @@ static struct power_supply_config configs[] = {
 
 static struct power_supply *supplies[ARRAY_SIZE(descriptions)];
 
+/* One page holding the mmap-able snapshot ring; see pi-battery.h. */
+static struct pi_battery_ring *telemetry_ring;
+
+/* Bumped on every committed update; lets pollers sleep between samples. */
+static u64 update_count;
+static DECLARE_WAIT_QUEUE_HEAD(update_waitq);
+
+/* Per-open state tracking which update a reader has consumed. */
+struct control_reader {
+    u64 seen;
+};
+
+static void
+ring_push(const struct battery_status *battery, int ac, u64 timestamp_ns)
+{
+    struct pi_battery_ring *ring = telemetry_ring;
+    struct pi_battery_record *rec;
+    u32 next;
+
+    if (!ring)
+        return;
+
+    /* slots fill from index 0, so the first commit lands in slot 0 and
+     * readers never see the untouched zeroes of a fresh ring */
+    next = ring->total % PI_BATTERY_RING_RECORDS;
+    rec = &ring->rec[next];
+
+    ring->seq++;
+    smp_wmb();
+
+    rec->timestamp_ns = timestamp_ns ? timestamp_ns : ktime_get_ns();
+    rec->status = battery->status;
+    rec->report.voltage_min_design = battery->voltage_min_design;
+    rec->report.voltage_now = battery->voltage_now;
+    rec->report.current_now = battery->current_now;
+    rec->report.charge_full_design = battery->charge_full_design;
+    rec->report.charge_full = battery->charge_full;
+    rec->report.charge_now = battery->charge_now;
+    rec->report.capacity = battery->capacity;
+    rec->report.ac_status = ac;
+    ring->head = next;
+    ring->total++;
+
+    smp_wmb();
+    ring->seq++;
+}
+
 static ssize_t
 control_device_read(struct file *file, char *buffer, size_t count, loff_t *ppos)
 {
+    struct control_reader *reader = file->private_data;
     static const char *message = "Pi battery information!";
     size_t message_len = strlen(message);
 
@@ -131,6 +247,9 @@ control_device_read(struct file *file, char *buffer, size_t count, loff_t *ppos)
     if (copy_to_user(buffer, message, message_len))
         return -EFAULT;
 
+    /* reading consumes the pending-update state for this opener */
+    reader->seen = update_count;
+
     *ppos = message_len;
     return message_len;
 }
@@ -207,8 +326,176 @@ handle_charge_changes(int ac_status, struct battery_status *battery)
         battery->capacity_level = POWER_SUPPLY_CAPACITY_LEVEL_LOW;
     else
         battery->capacity_level = POWER_SUPPLY_CAPACITY_LEVEL_CRITICAL;
+}
+
+static bool
+update_worth_notifying(const struct battery_status *battery, int ac)
+{
+    if (last_notified_ac != ac)
+        return true;
+    if (last_notified.status != battery->status)
+        return true;
+    if (last_notified.capacity != battery->capacity)
+        return true;
+    if (last_notified.capacity_level != battery->capacity_level)
+        return true;
+    if (last_notified.charge_full != battery->charge_full)
+        return true;
+    if (abs(last_notified.voltage_now - battery->voltage_now) >= notify_delta_uv)
+        return true;
+    if (abs(last_notified.current_now - battery->current_now) >= notify_delta_ua)
+        return true;
+
+    return false;
+}
+
+static struct miscdevice control_device;
+
+/*
+ * Self-describing change event on the control device.  The power_supply
+ * class generates its own uevents and offers no driver hook to extend
+ * them, so listeners that want the values without a sysfs re-read
+ * subscribe to the pi_battery misc device instead: the payload carries
+ * everything the delta gate considered meaningful.
+ */
+static void
+emit_change_uevent(const struct battery_status *battery, int ac)
+{
+    char status_env[32], capacity_env[32], voltage_env[40], current_env[40], ac_env[24];
+    char *envp[] = { status_env, capacity_env, voltage_env, current_env, ac_env, NULL };
+
+    if (!control_device.this_device)
+        return;
+
+    snprintf(status_env, sizeof(status_env), "PI_BATTERY_STATUS=%d", battery->status);
+    snprintf(capacity_env, sizeof(capacity_env), "PI_BATTERY_CAPACITY=%d", battery->capacity);
+    snprintf(voltage_env, sizeof(voltage_env), "PI_BATTERY_VOLTAGE_NOW=%d", battery->voltage_now);
+    snprintf(current_env, sizeof(current_env), "PI_BATTERY_CURRENT_NOW=%d", battery->current_now);
+    snprintf(ac_env, sizeof(ac_env), "PI_BATTERY_AC=%d", ac);
+
+    kobject_uevent_env(&control_device.this_device->kobj, KOBJ_CHANGE, envp);
+}
+
+/*
+ * Publish a fully-assembled snapshot from either the text or the binary
+ * write path: derive status/capacity_level, swap it in under the
+ * seqlock, then do the (possibly sleeping) notification work outside of
+ * the seqlock but still under commit_lock, so concurrent committers
+ * cannot tear the ring or lose notifications.  Batched writes pass
+ * notify = false for all but the final sample so a burst costs at most
+ * one notification.  from_userspace marks commits driven by userspace
+ * writers; those refresh the precedence stamp the in-kernel sampler
+ * honors.
+ */
+static void
+commit_battery_update(struct battery_status *battery, int ac, u64 timestamp_ns,
+        bool notify, bool from_userspace)
+{
+    handle_charge_changes(ac, battery);
+
+    mutex_lock(&commit_lock);
+
+    if (from_userspace)
+        last_userspace_commit_ns = ktime_get_ns();
 
-    //battery->time_left = 36 * battery->capacity;
+    write_seqlock(&status_lock);
+    pi_battery_status = *battery;
+    ac_status = ac;
+    if (!current_avg_ua)
+        current_avg_ua = abs(battery->current_now);
+    else
+        current_avg_ua += (abs(battery->current_now) - current_avg_ua) >> 3;
+    write_sequnlock(&status_lock);
+
+    ring_push(battery, ac, timestamp_ns);
+
+    trace_pi_battery_update(battery->status, battery->capacity,
+            battery->voltage_now, battery->current_now, ac, notify);
+
+    update_count++;
+
+    if (notify && update_worth_notifying(battery, ac)) {
+        last_notified = *battery;
+        last_notified_ac = ac;
+
+        trace_pi_battery_notify(battery->status, battery->capacity, ac);
+
+        power_supply_changed(supplies[0]);
+        power_supply_changed(supplies[1]);
+
+        emit_change_uevent(battery, ac);
+    }
+
+    mutex_unlock(&commit_lock);
+
+    if (notify)
+        wake_up_interruptible(&update_waitq);
+}
+
+static void
+apply_battery_report_at(const struct pi_battery_report *report, u64 timestamp_ns, bool notify)
+{
+    struct battery_status battery;
+    unsigned int seq;
+
+    do {
+        seq = read_seqbegin(&status_lock);
+        battery = pi_battery_status;
+    } while (read_seqretry(&status_lock, seq));
+
+    battery.voltage_min_design = report->voltage_min_design;
+    battery.voltage_now = report->voltage_now;
+    battery.current_now = report->current_now;
+    battery.charge_full_design = report->charge_full_design;
+    battery.charge_full = report->charge_full;
+    battery.charge_now = report->charge_now;
+    battery.capacity = report->capacity;
+
+    commit_battery_update(&battery, report->ac_status ? 1 : 0, timestamp_ns,
+            notify, true);
+}
+
+/*
+ * Batched binary write: a whole number of struct pi_battery_sample
+ * records, all carrying PI_BATTERY_SAMPLE_MAGIC.  Every sample is
+ * committed to the snapshot ring in order, but only the final one
+ * triggers the notification machinery.
+ */
+static ssize_t
+apply_sample_batch(const char *buffer, size_t count)
+{
+    struct pi_battery_sample *samples;
+    size_t nr = count / sizeof(*samples);
+    size_t i;
+
+    if (nr > PI_BATTERY_MAX_BATCH) {
+        printk(KERN_ERR "pi_battery: batch of %zu samples exceeds limit of %u\n",
+               nr, PI_BATTERY_MAX_BATCH);
+        return -EINVAL;
+    }
+
+    samples = kmalloc(count, GFP_KERNEL);
+    if (!samples)
+        return -ENOMEM;
+
+    if (copy_from_user(samples, buffer, count)) {
+        kfree(samples);
+        return -EFAULT;
+    }
+
+    for (i = 0; i < nr; i++) {
+        if (samples[i].magic != PI_BATTERY_SAMPLE_MAGIC) {
+            kfree(samples);
+            return -EINVAL;
+        }
+    }
+
+    for (i = 0; i < nr; i++)
+        apply_battery_report_at(&samples[i].report, samples[i].timestamp_ns,
+                                i == nr - 1);
+
+    kfree(samples);
+    return count;
 }
 
 static ssize_t
@@ -218,13 +505,26 @@ control_device_write(struct file *file, const char *buffer, size_t count, loff_t
     char *buffer_cursor;
     char *newline;
     size_t bytes_left = count;
+    struct battery_status battery;
+    int ac;
+    unsigned int seq;
     int status;
+    __u32 magic;
 
     if (*ppos != 0) {
         printk(KERN_ERR "writes to /dev/pi_battery must be completed in a single system call\n");
         return -EINVAL;
     }
 
+    /* binary batches announce themselves by size and leading magic */
+    if (count >= sizeof(struct pi_battery_sample) &&
+        count % sizeof(struct pi_battery_sample) == 0) {
+        if (get_user(magic, (const __u32 __user *)buffer))
+            return -EFAULT;
+        if (magic == PI_BATTERY_SAMPLE_MAGIC)
+            return apply_sample_batch(buffer, count);
+    }
+
     if (count > sizeof(kbuffer)) {
         printk(KERN_ERR "Too much data provided to /dev/pi_battery (limit %lu bytes)\n", sizeof(kbuffer));
         return -EINVAL;
@@ -233,10 +533,17 @@ control_device_write(struct file *file, const char *buffer, size_t count, loff_t
     if (copy_from_user(kbuffer, buffer, count))
         return -EFAULT;
 
+    /* start from the current snapshot; the text protocol may update a subset */
+    do {
+        seq = read_seqbegin(&status_lock);
+        battery = pi_battery_status;
+        ac = ac_status;
+    } while (read_seqretry(&status_lock, seq));
+
     buffer_cursor = kbuffer;
     while ((newline = memchr(buffer_cursor, '\n', bytes_left))) {
         *newline = '\0';
-        status = handle_control_line(buffer_cursor, &ac_status, &pi_battery_status);
+        status = handle_control_line(buffer_cursor, &ac, &battery);
         if (status)
             return status;
 
@@ -244,18 +551,350 @@ control_device_write(struct file *file, const char *buffer, size_t count, loff_t
         buffer_cursor = newline + 1;
     }
 
-    handle_charge_changes(ac_status, &pi_battery_status);
-
-    power_supply_changed(supplies[0]);
-    power_supply_changed(supplies[1]);
+    commit_battery_update(&battery, ac, 0, true, true);
 
     return count;
 }
 
+/*
+ * Optional in-kernel INA219 sampling.  With ina219_bus >= 0 the module
+ * reads the gauge itself from a delayed work - one in-kernel i2c
+ * transfer per sample instead of the daemon pipeline (chip -> i2c ->
+ * userspace -> text write -> parse), so battery data appears early in
+ * boot and survives daemon crashes.  Userspace writers take precedence:
+ * their commits stamp last_userspace_commit_ns, and the sampler stands
+ * down while that is fresh, so the richer estimators (dynamic
+ * calibration, coulomb counting) own the values whenever they run.
+ */
+
+static int ina219_bus = -1;
+module_param(ina219_bus, int, 0444);
+MODULE_PARM_DESC(ina219_bus, "i2c bus of the INA219 (-1 = sampling stays in userspace)");
+
+static int ina219_addr = 0x41;
+module_param(ina219_addr, int, 0444);
+MODULE_PARM_DESC(ina219_addr, "i2c address of the INA219");
+
+static int ina219_poll_ms = 2000;
+module_param(ina219_poll_ms, int, 0644);
+MODULE_PARM_DESC(ina219_poll_ms, "sampling period of the in-kernel INA219 mode");
+
+/* INA219 registers and pack constants - keep in sync with libbatmon.c */
+#define INA219_REG_CONFIG       0x00
+#define INA219_REG_SHUNTVOLTAGE 0x01
+#define INA219_REG_BUSVOLTAGE   0x02
+#define INA219_REG_CURRENT      0x04
+#define INA219_REG_CALIBRATION  0x05
+
+#define INA219_CALIBRATION      26868
+#define INA219_CURRENT_LSB_dUA  1524    /* 0.1524 mA in tenths of a uA */
+
+#define BAT_CAPACITY_UAH        7800000 /* 3 cells x 2600 mAh */
+#define BAT_VOLTAGE_FULL_MV     (4128 * 3)
+#define BAT_VOLTAGE_EMPTY_MV    (3100 * 3)
+#define BAT_FULL_CLAMP          99
+
+/* shunt LSB is 0.01 mV; discharging below -3.0 mV like the scripts */
+#define SHUNT_DISCHARGE_RAW     (-300)
+
+/*
+ * How long a userspace commit keeps the sampler standing down: 3x the
+ * monitors' slowest adaptive period (30 s), so a live daemon is never
+ * mistaken for a dead one between its samples.
+ */
+#define INA219_USERSPACE_GRACE_NS   (90ULL * NSEC_PER_SEC)
+
+static struct i2c_adapter *ina219_adapter;
+static struct delayed_work ina219_work;
+static int ina219_volt_avg_mv;
+
+static int
+ina219_write_u16(u8 reg, u16 value)
+{
+    u8 buf[3] = { reg, value >> 8, value & 0xFF };
+    struct i2c_msg msg = {
+        .addr = ina219_addr,
+        .flags = 0,
+        .len = sizeof(buf),
+        .buf = buf,
+    };
+
+    return i2c_transfer(ina219_adapter, &msg, 1) == 1 ? 0 : -EIO;
+}
+
+/*
+ * Shunt voltage, bus voltage and current in one transfer (repeated
+ * starts, no stop between registers) - the same coherent burst the
+ * userspace monitors use.
+ */
+static int
+ina219_read_regs(int *bus_raw, int *shunt_raw, int *current_raw)
+{
+    u8 regs[3] = { INA219_REG_SHUNTVOLTAGE, INA219_REG_BUSVOLTAGE, INA219_REG_CURRENT };
+    u8 data[3][2];
+    struct i2c_msg msgs[6];
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        msgs[2 * i].addr = ina219_addr;
+        msgs[2 * i].flags = 0;
+        msgs[2 * i].len = 1;
+        msgs[2 * i].buf = &regs[i];
+
+        msgs[2 * i + 1].addr = ina219_addr;
+        msgs[2 * i + 1].flags = I2C_M_RD;
+        msgs[2 * i + 1].len = 2;
+        msgs[2 * i + 1].buf = data[i];
+    }
+
+    if (i2c_transfer(ina219_adapter, msgs, 6) != 6)
+        return -EIO;
+
+    *shunt_raw = (s16)((data[0][0] << 8) | data[0][1]);
+    *bus_raw = (data[1][0] << 8) | data[1][1];
+    *current_raw = (s16)((data[2][0] << 8) | data[2][1]);
+    return 0;
+}
+
+static int
+ina219_configure(void)
+{
+    /* 16V range, 320mV shunt, 12bit x32 samples, continuous */
+    u16 config = (0x00 << 13) | (0x03 << 11) | (0x0D << 7) | (0x0D << 3) | 0x07;
+
+    if (ina219_write_u16(INA219_REG_CALIBRATION, INA219_CALIBRATION))
+        return -EIO;
+    return ina219_write_u16(INA219_REG_CONFIG, config);
+}
+
+static void
+ina219_work_fn(struct work_struct *work)
+{
+    struct battery_status battery;
+    int bus_raw, shunt_raw, current_raw;
+    int bus_mv, current_ua, soc, ac;
+    unsigned int seq;
+    bool stand_down;
+
+    /*
+     * Userspace monitors take precedence: while their commits are
+     * fresh, sampling here would just fight them over the snapshot
+     * and re-fire notifications every poll.  Keep polling so the
+     * fallback resumes once the daemon goes quiet.
+     */
+    mutex_lock(&commit_lock);
+    stand_down = last_userspace_commit_ns &&
+            ktime_get_ns() - last_userspace_commit_ns < INA219_USERSPACE_GRACE_NS;
+    mutex_unlock(&commit_lock);
+
+    if (stand_down) {
+        schedule_delayed_work(&ina219_work, msecs_to_jiffies(ina219_poll_ms));
+        return;
+    }
+
+    if (ina219_read_regs(&bus_raw, &shunt_raw, &current_raw) == 0) {
+        bus_mv = ((bus_raw >> 3) & 0x1FFF) * 4;
+        current_ua = abs(current_raw) * INA219_CURRENT_LSB_dUA / 10;
+
+        /* 1/8 EWMA smooths the voltage the SoC estimate comes from */
+        if (!ina219_volt_avg_mv)
+            ina219_volt_avg_mv = bus_mv;
+        else
+            ina219_volt_avg_mv += (bus_mv - ina219_volt_avg_mv) >> 3;
+
+        if (ina219_volt_avg_mv >= BAT_VOLTAGE_FULL_MV)
+            soc = 100;
+        else if (ina219_volt_avg_mv <= BAT_VOLTAGE_EMPTY_MV)
+            soc = 0;
+        else
+            soc = DIV_ROUND_UP((ina219_volt_avg_mv - BAT_VOLTAGE_EMPTY_MV) * 100,
+                    BAT_VOLTAGE_FULL_MV - BAT_VOLTAGE_EMPTY_MV);
+
+        ac = shunt_raw >= SHUNT_DISCHARGE_RAW;
+
+        do {
+            seq = read_seqbegin(&status_lock);
+            battery = pi_battery_status;
+        } while (read_seqretry(&status_lock, seq));
+
+        battery.voltage_min_design = BAT_VOLTAGE_EMPTY_MV * 1000;
+        battery.voltage_now = bus_mv * 1000;
+        battery.current_now = current_ua;
+        battery.charge_full_design = BAT_CAPACITY_UAH;
+        battery.charge_full = BAT_CAPACITY_UAH;
+        battery.charge_now = BAT_CAPACITY_UAH / 100 * soc;
+        battery.capacity = soc;
+
+        /* mobile-like clamp near 100%, like the userspace monitors */
+        if (soc >= BAT_FULL_CLAMP && ac) {
+            battery.capacity = 100;
+            battery.charge_now = battery.charge_full;
+            battery.current_now = 1000;
+        }
+
+        commit_battery_update(&battery, ac, 0, true, false);
+    } else {
+        printk_ratelimited(KERN_WARNING "pi_battery: INA219 read failed\n");
+    }
+
+    schedule_delayed_work(&ina219_work, msecs_to_jiffies(ina219_poll_ms));
+}
+
+static void
+ina219_start(void)
+{
+    if (ina219_bus < 0)
+        return;
+
+    ina219_adapter = i2c_get_adapter(ina219_bus);
+    if (!ina219_adapter) {
+        printk(KERN_WARNING "pi_battery: i2c bus %d not found, INA219 sampling disabled\n",
+               ina219_bus);
+        return;
+    }
+
+    if (ina219_configure()) {
+        printk(KERN_WARNING "pi_battery: INA219 at i2c-%d 0x%02x not responding, sampling disabled\n",
+               ina219_bus, ina219_addr);
+        i2c_put_adapter(ina219_adapter);
+        ina219_adapter = NULL;
+        return;
+    }
+
+    INIT_DELAYED_WORK(&ina219_work, ina219_work_fn);
+    schedule_delayed_work(&ina219_work, msecs_to_jiffies(100));
+    printk(KERN_INFO "pi_battery: sampling INA219 on i2c-%d 0x%02x every %d ms\n",
+           ina219_bus, ina219_addr, ina219_poll_ms);
+}
+
+static void
+ina219_stop(void)
+{
+    if (!ina219_adapter)
+        return;
+
+    cancel_delayed_work_sync(&ina219_work);
+    i2c_put_adapter(ina219_adapter);
+    ina219_adapter = NULL;
+}
+
+static void
+fill_battery_snapshot(struct pi_battery_snapshot *snap)
+{
+    struct battery_status status;
+    int ac;
+    unsigned int seq;
+
+    do {
+        seq = read_seqbegin(&status_lock);
+        status = pi_battery_status;
+        ac = ac_status;
+    } while (read_seqretry(&status_lock, seq));
+
+    snap->status = status.status;
+    snap->capacity_level = status.capacity_level;
+    snap->report.voltage_min_design = status.voltage_min_design;
+    snap->report.voltage_now = status.voltage_now;
+    snap->report.current_now = status.current_now;
+    snap->report.charge_full_design = status.charge_full_design;
+    snap->report.charge_full = status.charge_full;
+    snap->report.charge_now = status.charge_now;
+    snap->report.capacity = status.capacity;
+    snap->report.ac_status = ac;
+}
+
+static long
+control_device_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct control_reader *reader = file->private_data;
+    struct pi_battery_report report;
+    struct pi_battery_snapshot snap;
+
+    switch (cmd) {
+        case PI_BATTERY_SET_ALL:
+            if (copy_from_user(&report, (void __user *)arg, sizeof(report)))
+                return -EFAULT;
+            apply_battery_report_at(&report, 0, true);
+            return 0;
+        case PI_BATTERY_GET_ALL:
+            fill_battery_snapshot(&snap);
+            if (copy_to_user((void __user *)arg, &snap, sizeof(snap)))
+                return -EFAULT;
+            /* like read(), this consumes the pending-update state */
+            reader->seen = update_count;
+            return 0;
+        default:
+            return -ENOTTY;
+    }
+}
+
+static int
+control_device_open(struct inode *inode, struct file *file)
+{
+    struct control_reader *reader;
+
+    reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+    if (!reader)
+        return -ENOMEM;
+
+    reader->seen = update_count;
+    file->private_data = reader;
+    return 0;
+}
+
+static int
+control_device_release(struct inode *inode, struct file *file)
+{
+    kfree(file->private_data);
+    return 0;
+}
+
+static __poll_t
+control_device_poll(struct file *file, poll_table *wait)
+{
+    struct control_reader *reader = file->private_data;
+    __poll_t mask = EPOLLOUT | EPOLLWRNORM;
+
+    poll_wait(file, &update_waitq, wait);
+
+    if (reader->seen != update_count)
+        mask |= EPOLLIN | EPOLLRDNORM;
+
+    return mask;
+}
+
+static int
+control_device_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    unsigned long size = vma->vm_end - vma->vm_start;
+
+    if (size > PAGE_SIZE || vma->vm_pgoff != 0)
+        return -EINVAL;
+
+    /* The ring is a kernel-owned log; readers get it read-only. */
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+    /* vm_flags became const in 6.3; use the accessor */
+    vm_flags_clear(vma, VM_MAYWRITE);
+#else
+    vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+
+    return remap_pfn_range(vma, vma->vm_start,
+            virt_to_phys(telemetry_ring) >> PAGE_SHIFT,
+            size, vma->vm_page_prot);
+}
+
 static const struct file_operations control_device_ops = {
     .owner = THIS_MODULE,
+    .open = control_device_open,
+    .release = control_device_release,
     .read = control_device_read,
     .write = control_device_write,
+    .poll = control_device_poll,
+    .unlocked_ioctl = control_device_ioctl,
+    .mmap = control_device_mmap,
 };
 
 static struct miscdevice control_device = {
@@ -269,6 +908,15 @@ pi_battery_get_property(struct power_supply *psy,
         enum power_supply_property psp,
         union power_supply_propval *val)
 {
+    struct battery_status status;
+    int avg_ua;
+    unsigned int seq;
+
+    do {
+        seq = read_seqbegin(&status_lock);
+        status = pi_battery_status;
+        avg_ua = current_avg_ua;
+    } while (read_seqretry(&status_lock, seq));
 
     switch (psp) {
         case POWER_SUPPLY_PROP_MODEL_NAME:
@@ -281,7 +929,7 @@ pi_battery_get_property(struct power_supply *psy,
             val->strval = "Pi";
             break;
         case POWER_SUPPLY_PROP_STATUS:
-            val->intval = pi_battery_status.status;
+            val->intval = status.status;
             break;
         case POWER_SUPPLY_PROP_CHARGE_TYPE:
             val->intval = POWER_SUPPLY_CHARGE_TYPE_FAST;
@@ -296,33 +944,60 @@ pi_battery_get_property(struct power_supply *psy,
             val->intval = POWER_SUPPLY_TECHNOLOGY_LION;
             break;
         case POWER_SUPPLY_PROP_CAPACITY_LEVEL:
-            val->intval = pi_battery_status.capacity_level;
+            val->intval = status.capacity_level;
             break;
         case POWER_SUPPLY_PROP_CAPACITY:
-            val->intval = pi_battery_status.capacity;
+            val->intval = status.capacity;
             break;
         case POWER_SUPPLY_PROP_CHARGE_NOW:
-            val->intval = pi_battery_status.charge_now;
+            val->intval = status.charge_now;
             break;
         case POWER_SUPPLY_PROP_CHARGE_FULL_DESIGN:
-            val->intval = pi_battery_status.charge_full_design;
+            val->intval = status.charge_full_design;
             break;
         case POWER_SUPPLY_PROP_CHARGE_FULL:
-            val->intval = pi_battery_status.charge_full;
+            val->intval = status.charge_full;
             break;
         case POWER_SUPPLY_PROP_VOLTAGE_MIN_DESIGN:
-            val->intval = pi_battery_status.voltage_min_design;
+            val->intval = status.voltage_min_design;
             break;
         case POWER_SUPPLY_PROP_VOLTAGE_NOW:
-            val->intval = pi_battery_status.voltage_now;
+            val->intval = status.voltage_now;
             break;
         case POWER_SUPPLY_PROP_CURRENT_NOW:
-            val->intval = pi_battery_status.current_now;
+            val->intval = status.current_now;
+            break;
+        case POWER_SUPPLY_PROP_TIME_TO_EMPTY_NOW:
+            /* charge in uAh, current in uA: hours * 3600 = seconds */
+            if (status.status == POWER_SUPPLY_STATUS_DISCHARGING && avg_ua > 0)
+                val->intval = div_u64((u64)status.charge_now * 3600, avg_ua);
+            else
+                val->intval = 0;
+            break;
+        case POWER_SUPPLY_PROP_TIME_TO_FULL_NOW:
+            if (status.status == POWER_SUPPLY_STATUS_CHARGING && avg_ua > 0 &&
+                    status.charge_full > status.charge_now)
+                val->intval = div_u64((u64)(status.charge_full - status.charge_now) * 3600,
+                        avg_ua);
+            else
+                val->intval = 0;
             break;
         default:
             pr_info("%s: some properties deliberately report errors.\n", __func__);
             return -EINVAL;
     }
+
+    /* String properties fill val->strval; reading intval there would
+     * leak low bits of a kernel pointer into the trace. */
+    switch (psp) {
+        case POWER_SUPPLY_PROP_MODEL_NAME:
+        case POWER_SUPPLY_PROP_SERIAL_NUMBER:
+        case POWER_SUPPLY_PROP_MANUFACTURER:
+            break;
+        default:
+            trace_pi_battery_get_property(psp, val->intval);
+    }
+
     return 0;
 }
 
@@ -331,9 +1006,17 @@ pi_ac_get_property(struct power_supply *psy,
         enum power_supply_property psp,
         union power_supply_propval *val)
 {
+    int ac;
+    unsigned int seq;
+
+    do {
+        seq = read_seqbegin(&status_lock);
+        ac = ac_status;
+    } while (read_seqretry(&status_lock, seq));
+
     switch (psp) {
         case POWER_SUPPLY_PROP_ONLINE:
-            val->intval = ac_status;
+            val->intval = ac;
             break;
         default:
             return -EINVAL;
@@ -347,9 +1030,19 @@ pi_battery_init(void)
     int result;
     int i;
 
+    BUILD_BUG_ON(sizeof(struct pi_battery_ring) > PAGE_SIZE);
+
+    telemetry_ring = (struct pi_battery_ring *)get_zeroed_page(GFP_KERNEL);
+    if (!telemetry_ring)
+        return -ENOMEM;
+
+    telemetry_ring->records = PI_BATTERY_RING_RECORDS;
+    telemetry_ring->record_size = sizeof(struct pi_battery_record);
+
     result = misc_register(&control_device);
     if (result) {
         printk(KERN_ERR "Unable to register misc device!");
+        free_page((unsigned long)telemetry_ring);
         return result;
     }
 
@@ -361,6 +1054,8 @@ pi_battery_init(void)
         }
     }
 
+    ina219_start();
+
     printk(KERN_INFO "loaded pi_battery module\n");
     return 0;
 
@@ -369,6 +1064,7 @@ error:
         power_supply_unregister(supplies[i]);
 
     misc_deregister(&control_device);
+    free_page((unsigned long)telemetry_ring);
     return PTR_ERR(supplies[i]);
 }
 
@@ -377,10 +1073,13 @@ pi_battery_exit(void)
 {
     int i;
 
+    ina219_stop();
+
     for (i = ARRAY_SIZE(descriptions) - 1; i >= 0; i--)
         power_supply_unregister(supplies[i]);
 
     misc_deregister(&control_device);
+    free_page((unsigned long)telemetry_ring);
     printk(KERN_INFO "unloaded pi_battery module\n");
 }
 
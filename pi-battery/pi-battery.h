@@ -0,0 +1,118 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Shared userspace interface of the pi_battery control device.
+ *
+ * The text key=value protocol written to /dev/pi_battery stays supported;
+ * this header describes the binary alternative that pushes a whole battery
+ * report in a single copy instead of eight formatted decimal lines.
+ */
+
+#ifndef PI_BATTERY_H
+#define PI_BATTERY_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/*
+ * One full battery report, mirroring the keys of the text protocol.
+ * Units match what the text protocol already expects: voltages in µV,
+ * currents in µA, charges in µAh, capacity in percent.  ac_status is the
+ * "charging" key (1 = on AC, 0 = on battery).
+ */
+struct pi_battery_report {
+    __s32 voltage_min_design;
+    __s32 voltage_now;
+    __s32 current_now;
+    __s32 charge_full_design;
+    __s32 charge_full;
+    __s32 charge_now;
+    __s32 capacity;
+    __s32 ac_status;
+};
+
+#define PI_BATTERY_IOC_MAGIC 'b'
+
+/*
+ * Full state snapshot returned by PI_BATTERY_GET_ALL: the submitted
+ * report plus the fields the module derives itself.  One consistent
+ * copy per syscall instead of one sysfs open/read/close per property.
+ */
+struct pi_battery_snapshot {
+    __s32 status;          /* POWER_SUPPLY_STATUS_* */
+    __s32 capacity_level;  /* POWER_SUPPLY_CAPACITY_LEVEL_* */
+    struct pi_battery_report report;
+};
+
+/* Submit a complete report; replaces a whole text-protocol write. */
+#define PI_BATTERY_SET_ALL _IOW(PI_BATTERY_IOC_MAGIC, 1, struct pi_battery_report)
+
+/* Fetch the whole battery state as one consistent snapshot. */
+#define PI_BATTERY_GET_ALL _IOR(PI_BATTERY_IOC_MAGIC, 2, struct pi_battery_snapshot)
+
+/*
+ * Batched binary writes: a write() whose length is a whole number of
+ * struct pi_battery_sample records, each starting with
+ * PI_BATTERY_SAMPLE_MAGIC, is applied as an in-order batch.  Every
+ * sample lands in the snapshot ring (with its capture timestamp, if
+ * given), but at most one notification fires for the whole batch -
+ * one syscall and one uevent for a burst instead of one per sample.
+ */
+
+#define PI_BATTERY_SAMPLE_MAGIC 0x70694254  /* "piBT" */
+#define PI_BATTERY_MAX_BATCH 64
+
+struct pi_battery_sample {
+    __u32 magic;         /* PI_BATTERY_SAMPLE_MAGIC */
+    __u32 pad;
+    __u64 timestamp_ns;  /* CLOCK_MONOTONIC capture time, 0 = "now" */
+    struct pi_battery_report report;
+};
+
+/*
+ * Snapshot ring exported via mmap() on /dev/pi_battery.
+ *
+ * The module keeps the most recent PI_BATTERY_RING_RECORDS committed
+ * reports in a single read-only page.  Readers map the first page with
+ * PROT_READ/MAP_SHARED and get current and historical values with no
+ * syscall at all.  Tear-free read protocol: load seq (retry if odd),
+ * read head and the wanted record, reload seq and retry if it moved.
+ *
+ * Only min(total, records) slots hold data: with total == 0 nothing
+ * has been committed yet and head points at nothing.  Slots fill from
+ * index 0, so a history walk starts at index 0 until the ring wraps
+ * (total > records) and at (head + 1) % records afterwards.
+ */
+
+struct pi_battery_record {
+    __u64 timestamp_ns;  /* CLOCK_MONOTONIC time of the commit */
+    __s32 status;        /* POWER_SUPPLY_STATUS_* derived by the module */
+    __s32 pad;
+    struct pi_battery_report report;
+};
+
+#define PI_BATTERY_RING_RECORDS 64
+
+struct pi_battery_ring {
+    __u32 seq;          /* odd while a writer is mid-update */
+    __u32 head;         /* index of the most recent record */
+    __u32 records;      /* ring capacity of the running module */
+    __u32 record_size;  /* sizeof(struct pi_battery_record) */
+    __u64 total;        /* records committed since load; 0 = empty */
+    struct pi_battery_record rec[PI_BATTERY_RING_RECORDS];
+};
+
+#endif
@@ -29,13 +29,17 @@ import os
 import sys
 import time
 import math
+import mmap
 import errno
+import ctypes
+import signal
+import struct
 from collections import deque
 from dataclasses import dataclass
 from datetime import datetime
 
 try:
-    from smbus2 import SMBus
+    from smbus2 import SMBus, i2c_msg
 except Exception as e:
     print("ERROR: smbus2 is required (pip install smbus2)", file=sys.stderr)
     raise
@@ -53,6 +57,16 @@ VOLTAGE_HYSTERESIS_mV = 50  # per cell, for full-charge detection
 I2C_BUS = 2
 I2C_ADDR = 0x41
 
+# Additional INA219 rails on the same bus (deck revisions with more
+# sensors), sampled in the same scheduled pass as the battery so three
+# chips cost barely more than one. name -> I2C address.  Each rail logs
+# into its own telemetry ring (see RAIL_TELEMETRY_FILE) readable with
+# pi-battery-telemetry.py, and shows up in the DEBUG status block.
+EXTRA_RAILS = {
+    # "sys5v": 0x40,
+    # "display": 0x44,
+}
+
 # INA219 calibration constants (matching the Bash script)
 CALIBRATION = 26868
 POWER_LSB_W = 0.003048
@@ -62,14 +76,69 @@ SHUNT_RESISTOR_OHM = 0.01
 # Files
 BATFILE = "/dev/pi_battery"
 CALIBRATION_FILE = "/var/lib/batmon/calibration_data"
+TELEMETRY_FILE = "/var/lib/batmon/telemetry.ring"
+TELEMETRY_RECORDS = 524288  # ~12 days at a 2 s cadence, 16 MiB on disk
+# Auxiliary rails log into one ring each, same record format as the
+# battery's (so pi-battery-telemetry.py reads them unchanged) but
+# smaller: rails are for load debugging, not long-term history.
+RAIL_TELEMETRY_FILE = "/var/lib/batmon/telemetry-{name}.ring"
+RAIL_TELEMETRY_RECORDS = 65536  # ~1.5 days at a 2 s cadence, 2 MiB each
+
+# Estimator checkpoint (tmpfs): lets a restarted daemon resume with
+# converged averages instead of re-warming its windows from scratch.
+CHECKPOINT_FILE = "/run/batmon/estimator_checkpoint"
+CHECKPOINT_INTERVAL_S = 30
+CHECKPOINT_MAX_AGE_S = 600  # older state is stale; start cold instead
 
 # Averaging behavior
 AVG_WINDOW = 20
 MAX_HISTORY = 500
 
+# Hardware averaging: let the INA219 average 128 ADC samples in silicon and
+# poll the conversion-ready flag (CNVR) for fresh results, instead of piling
+# a 20-sample software window on top of the chip's 32-sample mode. The
+# software window then only needs to bridge a few readings, so a fresh value
+# stabilizes in seconds after startup instead of 40 s.
+HW_AVERAGING = True
+HW_AVG_SOFT_WINDOW = 3
+DEFAULT_AVG_WINDOW = HW_AVG_SOFT_WINDOW if HW_AVERAGING else AVG_WINDOW
+
+# Per-channel averaging windows. Lengthening a window (e.g. voltage, for a
+# stabler SoC) costs nothing per sample now that the average is incremental.
+VOLT_AVG_WINDOW = DEFAULT_AVG_WINDOW
+SHUNT_AVG_WINDOW = DEFAULT_AVG_WINDOW
+CURR_AVG_WINDOW = DEFAULT_AVG_WINDOW
+POWER_AVG_WINDOW = DEFAULT_AVG_WINDOW
+
+# Triggered sampling: run the ADC only when a sample is wanted - write a
+# one-shot conversion command, wait for CNVR, read the registers, and put
+# the chip into power-down until the next scheduled sample. Continuous
+# mode keeps the INA219 converting (~1 mA) even while the adaptive
+# scheduler idles at 10-30 s periods; one-shot drops the chip to
+# microamps averaged, with bus traffic only when data is wanted.
+TRIGGERED_SAMPLING = True
+
 # Loop behavior
 SAMPLE_PERIOD_S = 2.0
 
+# Adaptive sampling: drop to the fast period when the charge state flips or
+# the current moves quickly (to catch the voltage sag before a brownout),
+# back off geometrically toward the slow period while readings are stable.
+SAMPLE_PERIOD_FAST_S = 0.25
+SAMPLE_PERIOD_SLOW_S = 30.0
+SAMPLE_BACKOFF_FACTOR = 1.5
+SAMPLE_CURRENT_DELTA_A = 0.15
+
+# Suspend/resume: a wall-clock jump that CLOCK_MONOTONIC did not see
+# means the machine slept. The monitor then reconfigures the INA219
+# (its registers may be stale after a power gate), drops the pre-sleep
+# averages and refills the windows with a quick burst, so the first
+# trustworthy post-resume reading lands within about a second of wake
+# instead of after a full averaging warm-up.
+RESUME_JUMP_THRESHOLD_S = 5.0
+RESUME_BURST_SAMPLES = HW_AVG_SOFT_WINDOW
+RESUME_BURST_GAP_S = 0.1
+
 # Dynamic calibration
 CALIBRATION_INTERVAL_S = 3600
 
@@ -77,6 +146,12 @@ CALIBRATION_INTERVAL_S = 3600
 THRESHOLD_DISCHARGE_mV = -3.0
 THRESHOLD_CHARGE_mV = 0.2
 
+# Coulomb counting: integrate the measured current for SoC instead of
+# mapping voltage linearly, so capacity stops sagging when a heavy load
+# pulls the voltage down. Voltage is used only to anchor the endpoints
+# (full/empty); calibrate_if_full() keeps correcting long-term drift.
+COULOMB_COUNTING = True
+
 # =====================
 # Derived constants
 # =====================
@@ -98,27 +173,72 @@ REG_CALIBRATION = 0x05
 
 @dataclass
 class HistAvg:
+    """Rolling average with O(1) updates.
+
+    Keeps an incremental running sum instead of re-summing the whole buffer
+    on every add(), so the per-sample cost is constant no matter how long
+    the history is. The running sum is re-derived from the buffer every
+    RESYNC_EVERY samples to keep float drift from accumulating over
+    weeks of uptime.
+    """
+    RESYNC_EVERY = 65536
+
     maxlen: int = MAX_HISTORY
     win: int = AVG_WINDOW
 
     def __post_init__(self):
-        self.buf = deque(maxlen=self.maxlen)
+        self.buf = deque()
+        self.sum = 0.0
+        self.adds = 0
 
     def add(self, value: float) -> float:
-        self.buf.append(float(value))
+        value = float(value)
+        self.buf.append(value)
+        self.sum += value
+        if len(self.buf) > self.maxlen:
+            self.sum -= self.buf.popleft()
+
+        self.adds += 1
+        if self.adds % self.RESYNC_EVERY == 0:
+            self.sum = sum(self.buf)
+
         if len(self.buf) >= self.win:
-            return sum(self.buf) / len(self.buf)
+            return self.sum / len(self.buf)
         # fallback to the latest value if not enough samples yet (like original)
-        return float(value)
+        return value
+
+    def restore(self, mean: float, count: int) -> None:
+        """Rebuild a converged window from a checkpointed mean/count."""
+        count = min(int(count), self.maxlen)
+        self.buf = deque([float(mean)] * count)
+        self.sum = float(mean) * count
+        self.adds = count
+
+    def reset(self) -> None:
+        """Drop all history, e.g. stale pre-suspend values."""
+        self.buf.clear()
+        self.sum = 0.0
 
 
 class INA219:
-    def __init__(self, bus: int, addr: int):
-        self.bus_num = bus
+    def __init__(self, bus, addr: int):
+        # `bus` may be a bus number or an already-open SMBus to share:
+        # rails on the same bus reuse one file descriptor instead of
+        # fighting over /dev/i2c-N from separate handles.
+        if isinstance(bus, SMBus):
+            self.bus = bus
+            self._owns_bus = False
+        else:
+            self.bus = SMBus(bus)
+            self._owns_bus = True
         self.addr = addr
-        self.bus = SMBus(bus)
+        self.burst_ok = True  # cleared if the adapter rejects I2C_RDWR chains
+        self.triggered = False
+        self._config_base = (0x00 << 13) | (0x03 << 11) | (0x0D << 7) | (0x0D << 3)
 
     def close(self):
+        if not self._owns_bus:
+            return
         try:
             self.bus.close()
         except Exception:
@@ -135,22 +255,84 @@ class INA219:
         data = self.bus.read_i2c_block_data(self.addr, reg, 2)
         return (data[0] << 8) | data[1]
 
+    def _read_burst_u16(self, first_reg: int, count: int) -> list:
+        """Fetch `count` consecutive 16-bit registers in a single combined
+        I2C_RDWR transaction (repeated-start message chain). One bus
+        transaction instead of one start/stop cycle per register, so the
+        values are sampled back-to-back and bus occupancy drops to ~1/count.
+        """
+        msgs = []
+        reads = []
+        for reg in range(first_reg, first_reg + count):
+            msgs.append(i2c_msg.write(self.addr, [reg]))
+            rd = i2c_msg.read(self.addr, 2)
+            msgs.append(rd)
+            reads.append(rd)
+        self.bus.i2c_rdwr(*msgs)
+        return [(b[0] << 8) | b[1] for b in (bytes(rd) for rd in reads)]
+
     @staticmethod
     def _to_signed_16(val: int) -> int:
         return val - 0x10000 if val & 0x8000 else val
 
-    def configure(self):
+    # Operating mode bits (config register [2:0])
+    MODE_POWER_DOWN = 0x00
+    MODE_TRIGGERED = 0x03   # shunt + bus, one-shot
+    MODE_CONTINUOUS = 0x07  # shunt + bus, continuous
+
+    def configure(self, hw_averaging: bool = HW_AVERAGING,
+                  triggered: bool = TRIGGERED_SAMPLING):
         # Write calibration
         self._write_u16(REG_CALIBRATION, CALIBRATION)
-        # Config: 16V range, 320mV shunt, 12bit x32 samples, continuous mode
-        config = ((0x00 << 13) | (0x03 << 11) | (0x0D << 7) | (0x0D << 3) | 0x07)
-        self._write_u16(REG_CONFIG, config)
+        # ADC mode: 12bit x128 samples (~68 ms/conversion) with hardware
+        # averaging, else the original 12bit x32 samples
+        adc = 0x0F if hw_averaging else 0x0D
+        # Config without mode bits: 16V range, 320mV shunt, chosen ADC mode
+        self._config_base = (0x00 << 13) | (0x03 << 11) | (adc << 7) | (adc << 3)
+        self.triggered = triggered
+        if triggered:
+            # stay powered down until the first trigger()
+            self._write_u16(REG_CONFIG, self._config_base | self.MODE_POWER_DOWN)
+        else:
+            self._write_u16(REG_CONFIG, self._config_base | self.MODE_CONTINUOUS)
+
+    def trigger(self):
+        # Rewriting the config with a triggered mode starts one conversion
+        self._write_u16(REG_CONFIG, self._config_base | self.MODE_TRIGGERED)
+
+    def power_down(self):
+        self._write_u16(REG_CONFIG, self._config_base | self.MODE_POWER_DOWN)
+
+    def conversion_ready(self) -> bool:
+        # CNVR (bit 1 of the bus-voltage register) signals that a new
+        # (averaged) result is waiting; reading REG_POWER clears it.
+        return bool(self._read_u16(REG_BUSVOLTAGE) & 0x0002)
+
+    def wait_conversion_ready(self, timeout_s: float = 0.25) -> bool:
+        deadline = time.monotonic() + timeout_s
+        while True:
+            if self.conversion_ready():
+                return True
+            if time.monotonic() >= deadline:
+                return False
+            time.sleep(0.005)
 
     def read_all(self):
-        bus_raw = self._read_u16(REG_BUSVOLTAGE)
-        shunt_raw_u = self._read_u16(REG_SHUNTVOLTAGE)
-        current_raw_u = self._read_u16(REG_CURRENT)
-        power_raw_u = self._read_u16(REG_POWER)
+        if self.burst_ok:
+            try:
+                # registers 0x01-0x04: shunt, bus, power, current
+                shunt_raw_u, bus_raw, power_raw_u, current_raw_u = \
+                    self._read_burst_u16(REG_SHUNTVOLTAGE, 4)
+            except OSError as e:
+                print(f"WARN: combined I2C read unsupported ({e}), "
+                      "falling back to per-register reads", file=sys.stderr)
+                self.burst_ok = False
+
+        if not self.burst_ok:
+            bus_raw = self._read_u16(REG_BUSVOLTAGE)
+            shunt_raw_u = self._read_u16(REG_SHUNTVOLTAGE)
+            current_raw_u = self._read_u16(REG_CURRENT)
+            power_raw_u = self._read_u16(REG_POWER)
 
         shunt_raw = self._to_signed_16(shunt_raw_u)
         current_raw = self._to_signed_16(current_raw_u)
@@ -168,18 +350,164 @@ class INA219:
         return bus_raw, shunt_raw, current_raw, power_raw, bus_voltage_mV, shunt_voltage_mV, current_A, power_W
 
 
-class BatteryEstimator:
-    def __init__(self):
+class Rail:
+    """One auxiliary INA219 rail, smoothed with its own averaging windows.
+
+    Rails share the battery monitor's SMBus handle and are read in the
+    same pass per cycle, so additional sensors add one combined I2C
+    transaction each instead of a separate polling process.
+    """
+
+    def __init__(self, name: str, ina: "INA219"):
+        self.name = name
+        self.ina = ina
         self.volt_hist = HistAvg()
-        self.shunt_hist = HistAvg()
         self.curr_hist = HistAvg()
         self.power_hist = HistAvg()
 
+    def sample(self):
+        (_, _, _, _, bus_voltage_mV, shunt_voltage_mV, current_A, power_W) = self.ina.read_all()
+        return {
+            "bus_voltage_mV": bus_voltage_mV,
+            "bus_voltage_avg_mV": int(round(self.volt_hist.add(bus_voltage_mV))),
+            "shunt_voltage_mV": shunt_voltage_mV,
+            "current_A": current_A,
+            "current_avg_A": self.curr_hist.add(abs(current_A)),
+            "power_W": power_W,
+            "power_avg_W": self.power_hist.add(power_W),
+        }
+
+
+class CoulombCounter:
+    """Fixed-point charge integrator.
+
+    Tracks charge in integer µA·ms (signed current × elapsed
+    milliseconds, both integers), so one update is a handful of integer
+    ops with no float rounding no matter how long it runs. Charging
+    current (positive, per INA219 sign convention) adds charge,
+    discharge subtracts; the total is clamped to [0, charge_full].
+    """
+
+    def __init__(self):
+        self.charge_uAms = None
+        self.last_ms = None
+
+    @property
+    def seeded(self) -> bool:
+        return self.charge_uAms is not None
+
+    def seed(self, charge_now_uAh: int) -> None:
+        self.charge_uAms = charge_now_uAh * 3_600_000
+        self.last_ms = time.monotonic_ns() // 1_000_000
+
+    def anchor(self, charge_uAh: int) -> int:
+        """Pin the counter to a known endpoint (voltage says full/empty)."""
+        self.charge_uAms = charge_uAh * 3_600_000
+        return charge_uAh
+
+    def restore(self, charge_uAms: int) -> None:
+        self.charge_uAms = int(charge_uAms)
+        self.last_ms = time.monotonic_ns() // 1_000_000
+
+    def update(self, signed_current_uA: int, charge_full_uAh: int) -> int:
+        now_ms = time.monotonic_ns() // 1_000_000
+        dt_ms = now_ms - self.last_ms
+        self.last_ms = now_ms
+
+        self.charge_uAms += signed_current_uA * dt_ms
+        self.charge_uAms = max(0, min(self.charge_uAms, charge_full_uAh * 3_600_000))
+        return self.charge_uAms // 3_600_000
+
+
+class _BatmonResult(ctypes.Structure):
+    """Mirror of struct batmon_result in libbatmon.h."""
+    _fields_ = [
+        ("bus_voltage_avg_mV", ctypes.c_int),
+        ("shunt_voltage_avg_mV", ctypes.c_double),
+        ("current_avg_A", ctypes.c_double),
+        ("power_avg_W", ctypes.c_double),
+        ("soc_pct", ctypes.c_int),
+        ("charge_full_uAh", ctypes.c_longlong),
+        ("charge_now_uAh", ctypes.c_longlong),
+        ("current_now_uA", ctypes.c_int),
+        ("current_now_avg_uA", ctypes.c_int),
+        ("status_int", ctypes.c_int),
+        ("battery_remain_sec", ctypes.c_int),
+    ]
+
+
+def _load_libbatmon():
+    """ctypes handle to libbatmon.so, or None when it is not installed."""
+    here = os.path.dirname(os.path.abspath(__file__))
+    for candidate in (os.path.join(here, "libbatmon.so"), "libbatmon.so"):
+        try:
+            lib = ctypes.CDLL(candidate)
+        except OSError:
+            continue
+        try:
+            lib.batmon_new.restype = ctypes.c_void_p
+            lib.batmon_free.argtypes = [ctypes.c_void_p]
+            lib.batmon_step.restype = ctypes.c_int
+            lib.batmon_step.argtypes = [ctypes.c_void_p, ctypes.c_int,
+                                        ctypes.c_double, ctypes.c_double,
+                                        ctypes.c_double, ctypes.c_longlong,
+                                        ctypes.POINTER(_BatmonResult)]
+            lib.batmon_set_avg_window.restype = None
+            lib.batmon_set_avg_window.argtypes = [ctypes.c_void_p, ctypes.c_int]
+            lib.batmon_get_channel.restype = ctypes.c_int
+            lib.batmon_get_channel.argtypes = [ctypes.c_void_p, ctypes.c_int,
+                                               ctypes.POINTER(ctypes.c_double),
+                                               ctypes.POINTER(ctypes.c_int)]
+            lib.batmon_restore_channel.restype = ctypes.c_int
+            lib.batmon_restore_channel.argtypes = [ctypes.c_void_p, ctypes.c_int,
+                                                   ctypes.c_double, ctypes.c_int]
+            lib.batmon_set_calibration_file.restype = None
+            lib.batmon_set_calibration_file.argtypes = [ctypes.c_void_p,
+                                                        ctypes.c_char_p]
+        except AttributeError:
+            # library predates the window/checkpoint entry points; using it
+            # would reintroduce the 20-sample warm-up and lose warm restarts
+            print("WARN: libbatmon.so too old, using the Python estimator",
+                  file=sys.stderr)
+            return None
+        return lib
+    return None
+
+
+class BatteryEstimator:
+    def __init__(self):
+        self.volt_hist = HistAvg(win=VOLT_AVG_WINDOW)
+        self.shunt_hist = HistAvg(win=SHUNT_AVG_WINDOW)
+        self.curr_hist = HistAvg(win=CURR_AVG_WINDOW)
+        self.power_hist = HistAvg(win=POWER_AVG_WINDOW)
+        self.coulomb = CoulombCounter()
+
         # dynamic calibration state
         self.dynamic_charge_full_uAh = BAT_CAPACITY_mAh * 1000  # µAh
         self.last_calibration_time = 0
         self._load_calibration()
 
+        # warm-restart checkpoint state
+        self.last_checkpoint_time = 0
+        self._checkpoint_ok = True
+        self._load_checkpoint()
+
+        # Native fast path: step() becomes one libbatmon call instead of
+        # the interpreted pipeline.  The library implements the
+        # voltage-based estimator (and persists calibration itself), so
+        # the coulomb-counting mode stays in Python.  The library
+        # defaults to the 20-sample window of the continuous x32 config
+        # its C front-ends use, so hand it our window and any
+        # checkpointed state.
+        self._lib = None if COULOMB_COUNTING else _load_libbatmon()
+        self._native = self._lib.batmon_new() if self._lib else None
+        if self._native:
+            self._lib.batmon_set_avg_window(self._native, DEFAULT_AVG_WINDOW)
+            for idx, (_name, hist) in enumerate(self._hist_channels()):
+                if hist.buf:
+                    self._lib.batmon_restore_channel(
+                        self._native, idx, hist.sum / len(hist.buf), len(hist.buf))
+
     # -------- calibration persistence --------
     def _load_calibration(self):
         try:
@@ -210,6 +538,78 @@ class BatteryEstimator:
         except Exception as e:
             print(f"WARN: Failed to save calibration: {e}", file=sys.stderr)
 
+    # -------- estimator checkpoint (warm restarts) --------
+    def _hist_channels(self):
+        return (("VOLT", self.volt_hist), ("SHUNT", self.shunt_hist),
+                ("CURR", self.curr_hist), ("POWER", self.power_hist))
+
+    def _load_checkpoint(self):
+        try:
+            state = {}
+            with open(CHECKPOINT_FILE, "r") as f:
+                for line in f:
+                    line = line.strip()
+                    if line and "=" in line:
+                        k, v = line.split("=", 1)
+                        state[k] = v
+
+            if abs(int(time.time()) - int(state.get("TIMESTAMP", 0))) > CHECKPOINT_MAX_AGE_S:
+                return  # stale (long downtime or suspend); start cold
+
+            for name, hist in self._hist_channels():
+                if f"{name}_MEAN" in state and f"{name}_COUNT" in state:
+                    hist.restore(float(state[f"{name}_MEAN"]),
+                                 int(state[f"{name}_COUNT"]))
+            if "COULOMB_UAMS" in state:
+                self.coulomb.restore(int(state["COULOMB_UAMS"]))
+        except FileNotFoundError:
+            pass
+        except Exception as e:
+            print(f"WARN: Failed to load checkpoint: {e}", file=sys.stderr)
+
+    def _save_checkpoint(self, now_s: int):
+        self.last_checkpoint_time = now_s
+        if not self._checkpoint_ok:
+            return
+        try:
+            os.makedirs(os.path.dirname(CHECKPOINT_FILE), exist_ok=True)
+            tmp = CHECKPOINT_FILE + ".tmp"
+            with open(tmp, "w") as f:
+                f.write(f"TIMESTAMP={now_s}\n")
+                for idx, (name, hist) in enumerate(self._hist_channels()):
+                    if self._native:
+                        # the windows live in the library on the native path
+                        c_mean = ctypes.c_double()
+                        c_count = ctypes.c_int()
+                        self._lib.batmon_get_channel(
+                            self._native, idx,
+                            ctypes.byref(c_mean), ctypes.byref(c_count))
+                        mean, count = c_mean.value, c_count.value
+                    else:
+                        count = len(hist.buf)
+                        mean = hist.sum / count if count else 0.0
+                    f.write(f"{name}_MEAN={mean!r}\n")
+                    f.write(f"{name}_COUNT={count}\n")
+                if self.coulomb.seeded:
+                    f.write(f"COULOMB_UAMS={self.coulomb.charge_uAms}\n")
+            os.replace(tmp, CHECKPOINT_FILE)
+        except Exception as e:
+            print(f"WARN: checkpointing disabled: {e}", file=sys.stderr)
+            self._checkpoint_ok = False
+
+    def resume(self) -> None:
+        """Post-suspend reset: the rolling windows hold pre-sleep values
+        that would poison the averages, and the coulomb counter missed
+        whatever drained during sleep, so both start over - the counter
+        re-seeds from the first fresh voltage estimate. Long-term
+        calibration state is kept."""
+        for _name, hist in self._hist_channels():
+            hist.reset()
+        self.coulomb = CoulombCounter()
+        if self._native:
+            for idx in range(4):
+                self._lib.batmon_restore_channel(self._native, idx, 0.0, 0)
+
     # -------- core computations --------
     @staticmethod
     def soc_percent_from_voltage_mV(v_mV: int) -> int:
@@ -247,7 +647,42 @@ class BatteryEstimator:
         m = (seconds % 3600) // 60
         return f"{h} h {m:02d} min"
 
+    def _native_step(self, bus_voltage_mV: int, shunt_voltage_mV: float,
+                     current_A: float, power_W: float):
+        res = _BatmonResult()
+        now_s = int(time.time())
+        self._lib.batmon_step(self._native, bus_voltage_mV, shunt_voltage_mV,
+                              current_A, power_W, now_s,
+                              ctypes.byref(res))
+        self.dynamic_charge_full_uAh = res.charge_full_uAh
+
+        # same warm-restart cadence as the Python path
+        if now_s - self.last_checkpoint_time >= CHECKPOINT_INTERVAL_S:
+            self._save_checkpoint(now_s)
+
+        return {
+            "bus_voltage_mV": bus_voltage_mV,
+            "bus_voltage_avg_mV": res.bus_voltage_avg_mV,
+            "shunt_voltage_mV": shunt_voltage_mV,
+            "shunt_voltage_avg_mV": res.shunt_voltage_avg_mV,
+            "current_A": current_A,
+            "current_avg_A": res.current_avg_A,
+            "power_W": power_W,
+            "power_avg_W": res.power_avg_W,
+            "soc_pct": res.soc_pct,
+            "charge_full_uAh": res.charge_full_uAh,
+            "charge_now_uAh": res.charge_now_uAh,
+            "current_now_uA": res.current_now_uA,
+            "current_now_avg_uA": res.current_now_avg_uA,
+            "status_int": res.status_int,
+            "battery_remain_sec": res.battery_remain_sec,
+        }
+
     def step(self, bus_voltage_mV: int, shunt_voltage_mV: float, current_A: float, power_W: float):
+        if self._native:
+            return self._native_step(bus_voltage_mV, shunt_voltage_mV,
+                                     current_A, power_W)
+
         bus_voltage_avg_mV = int(round(self.volt_hist.add(bus_voltage_mV)))
         shunt_voltage_abs_mV = abs(shunt_voltage_mV)
         shunt_voltage_avg_mV = self.shunt_hist.add(shunt_voltage_abs_mV)
@@ -255,16 +690,36 @@ class BatteryEstimator:
         current_avg_A = self.curr_hist.add(current_abs_A)
         power_avg_W = self.power_hist.add(power_W)
 
+        status_int = self.status_from_shunt_mV(shunt_voltage_mV)
+
         soc_pct = self.soc_percent_from_voltage_mV(bus_voltage_avg_mV)
         charge_full_uAh = self.dynamic_charge_full_uAh
-        charge_now_uAh = (charge_full_uAh * soc_pct) // 100
+
+        if COULOMB_COUNTING:
+            if not self.coulomb.seeded:
+                # first sample: seed from the voltage estimate
+                self.coulomb.seed((charge_full_uAh * soc_pct) // 100)
+            charge_now_uAh = self.coulomb.update(int(current_A * 1_000_000),
+                                                 charge_full_uAh)
+            # voltage only anchors the endpoints
+            if bus_voltage_avg_mV >= BAT_VOLTAGE_FULL_mV and status_int != 2:
+                charge_now_uAh = self.coulomb.anchor(charge_full_uAh)
+            elif bus_voltage_avg_mV <= BAT_VOLTAGE_EMPTY_mV:
+                charge_now_uAh = self.coulomb.anchor(0)
+            # ceil like the voltage path, so "full" is reached
+            soc_pct = min(100, (charge_now_uAh * 100 + charge_full_uAh - 1)
+                          // charge_full_uAh)
+        else:
+            charge_now_uAh = (charge_full_uAh * soc_pct) // 100
+
         current_now_uA = int(current_abs_A * 1_000_000)
         current_now_avg_uA = int(current_avg_A * 1_000_000)
 
         now_s = int(time.time())
         self.calibrate_if_full(bus_voltage_mV, charge_now_uAh, now_s)
 
-        status_int = self.status_from_shunt_mV(shunt_voltage_mV)
+        if now_s - self.last_checkpoint_time >= CHECKPOINT_INTERVAL_S:
+            self._save_checkpoint(now_s)
 
         # --- Mobile-like behavior: clamp near 100% ---
         #if soc_pct >= 94 and status_int in (0, 1):
@@ -303,6 +758,162 @@ class BatteryEstimator:
         }
 
 
+class TelemetryRing:
+    """Memory-mapped fixed-record ring file for long-term battery history.
+
+    Each sample is one struct packed straight into the mapping - no
+    syscall, no text formatting, no fsync on the hot path; the kernel
+    writes dirty pages back lazily. The file has a fixed size, so weeks
+    of voltage/current/power history cost a bounded amount of disk.
+    Layout is shared with pi-battery-telemetry.py, the reader tool.
+    """
+
+    MAGIC = 0x31544D42  # "BMT1"
+    # magic, record_size, capacity, head, total
+    HEADER = struct.Struct("<IIIIQ")
+    # timestamp_s, bus_mV, shunt_uV, current_uA, power_mW, soc_pct, status
+    RECORD = struct.Struct("<QiiiiII")
+
+    def __init__(self, path: str = TELEMETRY_FILE, capacity: int = TELEMETRY_RECORDS):
+        self.capacity = capacity
+        size = self.HEADER.size + capacity * self.RECORD.size
+
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        new = not os.path.exists(path) or os.path.getsize(path) != size
+        self._f = open(path, "w+b" if new else "r+b")
+        if new:
+            self._f.truncate(size)
+        self._mm = mmap.mmap(self._f.fileno(), size)
+
+        magic, record_size, cap, head, total = self.HEADER.unpack_from(self._mm, 0)
+        if magic == self.MAGIC and record_size == self.RECORD.size and cap == capacity:
+            self.head = head
+            self.total = total
+        else:
+            self.head = 0
+            self.total = 0
+            self.HEADER.pack_into(self._mm, 0, self.MAGIC, self.RECORD.size,
+                                  capacity, 0, 0)
+
+    def append(self, bus_mV: int, shunt_mV: float, current_A: float,
+               power_W: float, soc_pct: int, status: int) -> None:
+        if self.total:
+            self.head = (self.head + 1) % self.capacity
+        self.total += 1
+        offset = self.HEADER.size + self.head * self.RECORD.size
+        self.RECORD.pack_into(self._mm, offset,
+                              int(time.time()),
+                              int(bus_mV),
+                              int(shunt_mV * 1000),
+                              int(current_A * 1_000_000),
+                              int(power_W * 1000),
+                              int(soc_pct),
+                              int(status))
+        self.HEADER.pack_into(self._mm, 0, self.MAGIC, self.RECORD.size,
+                              self.capacity, self.head, self.total)
+
+    def close(self):
+        try:
+            self._mm.close()
+            self._f.close()
+        except Exception:
+            pass
+
+
+class AdaptiveScheduler:
+    """Chooses the delay until the next sample from how much the battery
+    is actually doing.
+
+    A status flip or a fast-moving current resets the period to
+    SAMPLE_PERIOD_FAST_S so transients are caught while they happen;
+    stable readings let the period grow by SAMPLE_BACKOFF_FACTOR up to
+    SAMPLE_PERIOD_SLOW_S, so an idle deck is not woken every 2 seconds
+    for identical values.
+    """
+
+    def __init__(self):
+        self.period = SAMPLE_PERIOD_S
+        self.last_status = None
+        self.last_current_A = None
+
+    def next_delay(self, status_int: int, current_A: float) -> float:
+        active = (
+            self.last_status is None
+            or status_int != self.last_status
+            or abs(current_A - self.last_current_A) > SAMPLE_CURRENT_DELTA_A
+        )
+        if active:
+            self.period = SAMPLE_PERIOD_FAST_S
+        else:
+            self.period = min(self.period * SAMPLE_BACKOFF_FACTOR, SAMPLE_PERIOD_SLOW_S)
+
+        self.last_status = status_int
+        self.last_current_A = current_A
+        return self.period
+
+
+class LatencyTrack:
+    """One instrumented duration: a power-of-two-bucket histogram over
+    the whole runtime plus a bounded recent window for percentiles.
+    Adding a sample is a few integer ops; the sorting cost is paid only
+    when a dump is requested."""
+
+    WINDOW = 2048          # recent samples kept for percentiles
+    BUCKETS = 22           # 1 us .. ~2 s in powers of two
+
+    def __init__(self, name: str):
+        self.name = name
+        self.buckets = [0] * self.BUCKETS
+        self.recent = deque(maxlen=self.WINDOW)
+        self.count = 0
+
+    def add(self, seconds: float) -> None:
+        us = max(1, int(seconds * 1e6))
+        self.buckets[min(us.bit_length() - 1, self.BUCKETS - 1)] += 1
+        self.recent.append(us)
+        self.count += 1
+
+    def percentile(self, p: float) -> int:
+        if not self.recent:
+            return 0
+        ordered = sorted(self.recent)
+        return ordered[min(len(ordered) - 1, int(len(ordered) * p / 100))]
+
+    def summary(self) -> str:
+        if not self.recent:
+            return f"{self.name:<12} n=0"
+        return (f"{self.name:<12} n={self.count} "
+                f"p50={self.percentile(50)}us p99={self.percentile(99)}us "
+                f"max={max(self.recent)}us")
+
+
+class CycleStats:
+    """Self-instrumentation of the sampling loop: I2C transaction
+    latency, estimator compute time, batfile write time and scheduler
+    jitter (how late sleep() woke us). `kill -USR1 <pid>` dumps the
+    aggregates to stderr without disturbing the loop."""
+
+    def __init__(self):
+        self.i2c = LatencyTrack("i2c")
+        self.estimator = LatencyTrack("estimator")
+        self.write = LatencyTrack("write")
+        self.jitter = LatencyTrack("jitter")
+        self.started = time.monotonic()
+
+    def tracks(self):
+        return (self.i2c, self.estimator, self.write, self.jitter)
+
+    def dump(self, *_args) -> None:
+        print(f"--- cycle stats ({time.monotonic() - self.started:.0f} s uptime) ---",
+              file=sys.stderr)
+        for track in self.tracks():
+            print(track.summary(), file=sys.stderr)
+        sys.stderr.flush()
+
+    def install_signal_handler(self) -> None:
+        signal.signal(signal.SIGUSR1, self.dump)
+
+
 STATUS_MAP = {0: "Full", 1: "Charging", 2: "Discharging"}
 
 
@@ -338,12 +949,77 @@ def main():
 
     ina = INA219(I2C_BUS, I2C_ADDR)
     est = BatteryEstimator()
+    sched = AdaptiveScheduler()
+    stats = CycleStats()
+    stats.install_signal_handler()
+
+    # auxiliary rails share the battery monitor's bus handle
+    rails = [Rail(name, INA219(ina.bus, addr))
+             for name, addr in EXTRA_RAILS.items()]
+
+    try:
+        telemetry = TelemetryRing()
+    except OSError as e:
+        print(f"WARN: telemetry ring disabled: {e}", file=sys.stderr)
+        telemetry = None
+
+    # one ring per rail; SoC/status have no rail meaning and stay 0
+    rail_rings = {}
+    for rail in rails:
+        try:
+            rail_rings[rail.name] = TelemetryRing(
+                RAIL_TELEMETRY_FILE.format(name=rail.name),
+                RAIL_TELEMETRY_RECORDS)
+        except OSError as e:
+            print(f"WARN: rail {rail.name} telemetry disabled: {e}",
+                  file=sys.stderr)
+
+    def resume_fast_path(suspended_s: float) -> None:
+        """Recovery after a suspend: reconfigure the chip, drop the stale
+        averages and push a prioritized burst of fresh samples into
+        BATFILE instead of waiting out the normal schedule."""
+        print(f"INFO: resume detected (~{suspended_s:.0f} s suspended), "
+              "reinitializing", file=sys.stderr)
+        ina.configure()
+        for rail in rails:
+            rail.ina.configure(triggered=False)
+        est.resume()
+        sched.last_status = None  # next_delay() restarts at the fast period
+
+        for _ in range(RESUME_BURST_SAMPLES):
+            if ina.triggered:
+                ina.trigger()
+                ina.wait_conversion_ready(timeout_s=0.5)
+            elif HW_AVERAGING:
+                ina.wait_conversion_ready()
+            (_, _, _, _, bus_voltage_mV, shunt_voltage_mV,
+             current_A, power_W) = ina.read_all()
+            payload = est.step(bus_voltage_mV=bus_voltage_mV,
+                               shunt_voltage_mV=shunt_voltage_mV,
+                               current_A=current_A, power_W=power_W)
+            write_batfile(payload)
+            time.sleep(RESUME_BURST_GAP_S)
+        if ina.triggered:
+            ina.power_down()
 
     try:
         ina.configure()
+        for rail in rails:
+            # rails are read without a trigger step, so they stay continuous
+            rail.ina.configure(triggered=False)
         time.sleep(1.0)
 
         while True:
+            t0 = time.monotonic()
+            if ina.triggered:
+                # one-shot: start a conversion, wait for it, read below,
+                # then power the chip down until the next sample
+                ina.trigger()
+                # 12bit x128 averaging runs ~68 ms per channel
+                ina.wait_conversion_ready(timeout_s=0.5)
+            elif HW_AVERAGING:
+                ina.wait_conversion_ready()
+
             (
                 bus_raw,
                 shunt_raw,
@@ -354,6 +1030,8 @@ def main():
                 current_A,
                 power_W,
             ) = ina.read_all()
+            t1 = time.monotonic()
+            stats.i2c.add(t1 - t0)
 
             payload = est.step(
                 bus_voltage_mV=bus_voltage_mV,
@@ -361,8 +1039,33 @@ def main():
                 current_A=current_A,
                 power_W=power_W,
             )
+            t2 = time.monotonic()
+            stats.estimator.add(t2 - t1)
 
             write_batfile(payload)
+            stats.write.add(time.monotonic() - t2)
+
+            if telemetry:
+                telemetry.append(bus_voltage_mV, shunt_voltage_mV, current_A,
+                                 power_W, payload['soc_pct'], payload['status_int'])
+
+            for rail in rails:
+                try:
+                    rail_data = rail.sample()
+                except OSError as e:
+                    print(f"WARN: rail {rail.name} read failed: {e}", file=sys.stderr)
+                    continue
+                rail_ring = rail_rings.get(rail.name)
+                if rail_ring:
+                    rail_ring.append(rail_data['bus_voltage_mV'],
+                                     rail_data['shunt_voltage_mV'],
+                                     rail_data['current_A'],
+                                     rail_data['power_W'], 0, 0)
+                if DEBUG:
+                    print(f"rail {rail.name}: "
+                          f"{rail_data['bus_voltage_avg_mV']} mV, "
+                          f"{rail_data['current_avg_A']:.3f} A, "
+                          f"{rail_data['power_avg_W']:.3f} W")
 
             if DEBUG:
                 t=datetime.now().strftime("%Y-%m-%d %H:%M:%S")
@@ -402,11 +1105,29 @@ def main():
 
                 print(f"Data written to {BATFILE}\n---------------------------------------------------\n")
 
-            time.sleep(SAMPLE_PERIOD_S)
+            if ina.triggered:
+                ina.power_down()
+
+            delay = sched.next_delay(payload['status_int'], current_A)
+            wall_start = time.time()
+            sleep_start = time.monotonic()
+            time.sleep(delay)
+            mono_slept = time.monotonic() - sleep_start
+            stats.jitter.add(max(0.0, mono_slept - delay))
+
+            # CLOCK_MONOTONIC stops during suspend while wall time runs
+            # on: a large difference means the machine just woke up
+            suspended_s = (time.time() - wall_start) - mono_slept
+            if suspended_s > RESUME_JUMP_THRESHOLD_S:
+                resume_fast_path(suspended_s)
 
     except KeyboardInterrupt:
         pass
     finally:
+        if telemetry:
+            telemetry.close()
+        for rail_ring in rail_rings.values():
+            rail_ring.close()
         ina.close()
 
 
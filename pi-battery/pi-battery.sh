@@ -3,6 +3,17 @@
 # Non-locale numbers for consistent decimal formatting
 export LC_ALL=C
 
+# The compiled front-end (see libbatmon.c / batmon-cli.c) runs the same
+# cycle natively - one process instead of dozens of awk/bc/i2cget forks
+# every 2 seconds.  Prefer it when installed; the shell loop below stays
+# as the dependency-free fallback.
+if command -v batmon-cli >/dev/null 2>&1; then
+	# -o rewrites the log once per cycle, like the per-cycle tee in the
+	# loop below - an appending tee here would grow the tmpfs file forever
+	batmon-cli -l 2 -q -o /dev/shm/pi_battery.log
+	exit $?
+fi
+
 # Configuration
 BAT_CELLS=3
 BAT_CELL_CAPACITY=2600